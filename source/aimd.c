@@ -0,0 +1,210 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * System includes
+ */
+#include <string.h>
+#include <time.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * Local includes
+ */
+#include "aimd.h"
+
+static uint64_t
+aimd_usec_between(struct timespec * Start, struct timespec * End)
+{
+	return (uint64_t)(End->tv_sec - Start->tv_sec) * 1000000 +
+	       (End->tv_nsec - Start->tv_nsec) / 1000;
+}
+
+void
+aimd_init(aimd_t * Aimd, int Max)
+{
+	memset(Aimd, 0, sizeof(aimd_t));
+
+	if (Max < 1)
+		Max = 1;
+
+	Aimd->Target = 1;
+	Aimd->Max    = Max;
+	Aimd->High   = 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &Aimd->Begin);
+	Aimd->IntervalStart = Aimd->Begin;
+}
+
+static void
+aimd_next_interval(aimd_t * Aimd, struct timespec * Now)
+{
+	Aimd->IntervalStart = *Now;
+	Aimd->Bytes         = 0;
+	Aimd->LatencyUsec   = 0;
+	Aimd->LatencyCnt    = 0;
+}
+
+static void
+aimd_backoff(aimd_t * Aimd, struct timespec * Now)
+{
+	/* Streams already parking have not had time to take effect. */
+	if (Aimd->Backoffs && aimd_usec_between(&Aimd->LastBackoff, Now) < AIMD_INTERVAL)
+		return;
+
+	Aimd->Target /= 2;
+	if (Aimd->Target < 1)
+		Aimd->Target = 1;
+
+	Aimd->LastBackoff = *Now;
+	Aimd->Backoffs++;
+
+	/* Climb again from here. */
+	Aimd->LastRate = 0;
+	Aimd->Settling = 1;
+	Aimd->Plateau  = 0;
+	aimd_next_interval(Aimd, Now);
+}
+
+int
+aimd_bytes(aimd_t * Aimd, uint64_t Bytes)
+{
+	struct timespec now;
+	uint64_t        usec    = 0;
+	uint64_t        rate    = 0;
+	uint64_t        latency = 0;
+	int             grew    = 0;
+
+	Aimd->Bytes      += Bytes;
+	Aimd->TotalBytes += Bytes;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	usec = aimd_usec_between(&Aimd->IntervalStart, &now);
+	if (usec < AIMD_INTERVAL)
+		return 0;
+
+	rate = Aimd->Bytes * 1000000 / usec;
+
+	if (Aimd->LatencyCnt)
+	{
+		latency = Aimd->LatencyUsec / Aimd->LatencyCnt;
+
+		if (Aimd->BaseLatency && latency * 100 > Aimd->BaseLatency * AIMD_LATENCY_RISE)
+		{
+			aimd_backoff(Aimd, &now);
+			return 0;
+		}
+
+		if (!Aimd->BaseLatency || latency < Aimd->BaseLatency)
+			Aimd->BaseLatency = latency;
+	}
+
+	if (Aimd->Settling)
+	{
+		/* The last stream added is still getting up to speed. */
+		Aimd->Settling = 0;
+	} else if (Aimd->Plateau && ++Aimd->Plateau <= AIMD_PROBE)
+	{
+		/* Holding. */
+	} else if (Aimd->LastRate && rate * 100 < Aimd->LastRate * (100 + AIMD_GAIN) && !Aimd->Plateau)
+	{
+		/* The last addition did not help. */
+		Aimd->Plateau = 1;
+	} else if (Aimd->Target < Aimd->Max)
+	{
+		Aimd->LastRate = rate;
+		Aimd->Plateau  = 0;
+		Aimd->Settling = 1;
+		Aimd->Target++;
+		if (Aimd->Target > Aimd->High)
+			Aimd->High = Aimd->Target;
+		grew = 1;
+	}
+
+	aimd_next_interval(Aimd, &now);
+	return grew;
+}
+
+void
+aimd_latency(aimd_t * Aimd, struct timespec * Start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	Aimd->LatencyUsec += aimd_usec_between(Start, &now);
+	Aimd->LatencyCnt++;
+}
+
+void
+aimd_congested(aimd_t * Aimd)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	aimd_backoff(Aimd, &now);
+}
+
+void
+aimd_log(aimd_t * Aimd, const char * Name, const char * Path)
+{
+	struct timespec now;
+	uint64_t        usec = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	usec = aimd_usec_between(&Aimd->Begin, &now);
+
+	globus_gfs_log_message(GLOBUS_GFS_LOG_INFO,
+	                       "BlackPearl %s %s: %d DS3 streams at the end (high %d, max %d), "
+	                       "%d backoffs, %llu bytes in %llu ms (%llu bytes/sec)\n",
+	                       Name,
+	                       Path,
+	                       Aimd->Target,
+	                       Aimd->High,
+	                       Aimd->Max,
+	                       Aimd->Backoffs,
+	                       (unsigned long long)Aimd->TotalBytes,
+	                       (unsigned long long)(usec / 1000),
+	                       (unsigned long long)(usec ? Aimd->TotalBytes * 1000000 / usec : 0));
+}
@@ -0,0 +1,106 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * Per-transfer controller for the number of concurrent DS3 streams. A
+ * transfer starts with one stream and adds one more each time aggregate
+ * throughput rises by AIMD_GAIN percent over the rate before the last
+ * addition. Once throughput stops rising, it holds and probes again every
+ * AIMD_PROBE intervals. A busy BlackPearl (503 or retry_after) or request
+ * latency past AIMD_LATENCY_RISE percent of the lowest seen halves the
+ * stream count, at most once per interval.
+ *
+ * Streams numbered Target and up park before taking their next chunk.
+ */
+
+#ifndef BLACKPEARL_DSI_AIMD_H
+#define BLACKPEARL_DSI_AIMD_H
+
+/*
+ * System includes
+ */
+#include <stdint.h>
+#include <time.h>
+
+#define AIMD_INTERVAL     2000000 // usec
+#define AIMD_GAIN         5       // percent
+#define AIMD_PROBE        15      // intervals
+#define AIMD_LATENCY_RISE 200     // percent
+
+typedef struct {
+	int Target; // Streams allowed to run
+	int Max;
+	int High;
+
+	struct timespec Begin;
+	struct timespec IntervalStart;
+	struct timespec LastBackoff;
+	uint64_t        Bytes;        // This interval
+	uint64_t        LatencyUsec;  // This interval
+	uint64_t        LatencyCnt;   // This interval
+	uint64_t        BaseLatency;  // Lowest interval average seen
+	uint64_t        LastRate;     // bytes/sec before the last addition
+	int             Settling;     // The interval after an addition
+	int             Plateau;      // Intervals since throughput stopped rising
+
+	uint64_t        TotalBytes;
+	int             Backoffs;
+} aimd_t;
+
+void
+aimd_init(aimd_t * Aimd, int Max);
+
+/* Returns 1 if Target grew, so parked streams should be woken. */
+int
+aimd_bytes(aimd_t * Aimd, uint64_t Bytes);
+
+/* Round trip of one DS3 request. */
+void
+aimd_latency(aimd_t * Aimd, struct timespec * Start);
+
+/* The BlackPearl turned a request away. */
+void
+aimd_congested(aimd_t * Aimd);
+
+void
+aimd_log(aimd_t * Aimd, const char * Name, const char * Path);
+
+#endif /* BLACKPEARL_DSI_AIMD_H */
@@ -0,0 +1,173 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * Local includes
+ */
+#include "bufq.h"
+
+void
+bufq_list_init(bufq_list_t * List)
+{
+	List->Head.Next = &List->Head;
+	List->Head.Prev = &List->Head;
+	List->Count     = 0;
+}
+
+void
+bufq_list_insert(bufq_list_t * List, bufq_link_t * Link)
+{
+	Link->Next            = List->Head.Next;
+	Link->Prev            = &List->Head;
+	List->Head.Next->Prev = Link;
+	List->Head.Next       = Link;
+	List->Count++;
+}
+
+void
+bufq_list_remove(bufq_list_t * List, bufq_link_t * Link)
+{
+	Link->Prev->Next = Link->Next;
+	Link->Next->Prev = Link->Prev;
+	Link->Next       = NULL;
+	Link->Prev       = NULL;
+	List->Count--;
+}
+
+bufq_link_t *
+bufq_list_pop(bufq_list_t * List)
+{
+	bufq_link_t * link = List->Head.Next;
+
+	if (link == &List->Head)
+		return NULL;
+
+	bufq_list_remove(List, link);
+	return link;
+}
+
+void
+bufq_stack_push(bufq_stack_t * Stack, bufq_entry_t * Entry)
+{
+	Entry->Next = Stack->Top;
+	Stack->Top  = Entry;
+	Stack->Count++;
+}
+
+bufq_entry_t *
+bufq_stack_pop(bufq_stack_t * Stack)
+{
+	bufq_entry_t * entry = Stack->Top;
+
+	if (entry)
+	{
+		Stack->Top  = entry->Next;
+		entry->Next = NULL;
+		Stack->Count--;
+	}
+	return entry;
+}
+
+/*
+ * Offsets are usually multiples of the block size, so mix the bits before
+ * picking a bucket.
+ */
+static int
+bufq_hash(uint64_t Offset)
+{
+	return ((Offset * 0x9e3779b97f4a7c15ULL) >> 56) & (BUFQ_TABLE_SIZE - 1);
+}
+
+void
+bufq_table_insert(bufq_table_t * Table, bufq_entry_t * Entry, uint64_t Offset)
+{
+	int bucket = bufq_hash(Offset);
+
+	Entry->Offset          = Offset;
+	Entry->Next            = Table->Buckets[bucket];
+	Table->Buckets[bucket] = Entry;
+	Table->Count++;
+}
+
+bufq_entry_t *
+bufq_table_find(bufq_table_t * Table, uint64_t Offset)
+{
+	bufq_entry_t * entry = Table->Buckets[bufq_hash(Offset)];
+
+	while (entry && entry->Offset != Offset)
+		entry = entry->Next;
+	return entry;
+}
+
+bufq_entry_t *
+bufq_table_remove(bufq_table_t * Table, uint64_t Offset)
+{
+	bufq_entry_t ** prev  = &Table->Buckets[bufq_hash(Offset)];
+	bufq_entry_t  * entry = NULL;
+
+	while (*prev && (*prev)->Offset != Offset)
+		prev = &(*prev)->Next;
+
+	entry = *prev;
+	if (entry)
+	{
+		*prev       = entry->Next;
+		entry->Next = NULL;
+		Table->Count--;
+	}
+	return entry;
+}
+
+bufq_entry_t *
+bufq_table_pop(bufq_table_t * Table)
+{
+	int i = 0;
+
+	if (!Table->Count)
+		return NULL;
+
+	for (i = 0; i < BUFQ_TABLE_SIZE; i++)
+	{
+		if (Table->Buckets[i])
+			return bufq_table_remove(Table, Table->Buckets[i]->Offset);
+	}
+	return NULL;
+}
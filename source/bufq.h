@@ -0,0 +1,131 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * Allocation-free bookkeeping for data buffers. The links live inside the
+ * buffer structs, so moving a buffer between lists never mallocs, and every
+ * container keeps its own count.
+ */
+
+#ifndef BLACKPEARL_DSI_BUFQ_H
+#define BLACKPEARL_DSI_BUFQ_H
+
+/*
+ * System includes
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+/* Recovers the buffer struct from one of its embedded links. */
+#define bufq_container(Ptr, Type, Member) \
+	((Type *)((char *)(Ptr) - offsetof(Type, Member)))
+
+/*
+ * Doubly linked list, for every buffer a transfer owns.
+ */
+typedef struct bufq_link {
+	struct bufq_link * Next;
+	struct bufq_link * Prev;
+} bufq_link_t;
+
+typedef struct {
+	bufq_link_t Head;
+	int         Count;
+} bufq_list_t;
+
+/*
+ * An entry sits on at most one stack or table at a time; free buffers sit on
+ * a LIFO stack and full buffers in a table keyed by offset.
+ */
+typedef struct bufq_entry {
+	struct bufq_entry * Next;
+	uint64_t            Offset;
+} bufq_entry_t;
+
+typedef struct {
+	bufq_entry_t * Top;
+	int            Count;
+} bufq_stack_t;
+
+/* Must be a power of 2. */
+#define BUFQ_TABLE_SIZE 256
+
+typedef struct {
+	bufq_entry_t * Buckets[BUFQ_TABLE_SIZE];
+	int            Count;
+} bufq_table_t;
+
+void
+bufq_list_init(bufq_list_t * List);
+
+void
+bufq_list_insert(bufq_list_t * List, bufq_link_t * Link);
+
+void
+bufq_list_remove(bufq_list_t * List, bufq_link_t * Link);
+
+/* Removes and returns any link, NULL if the list is empty. */
+bufq_link_t *
+bufq_list_pop(bufq_list_t * List);
+
+void
+bufq_stack_push(bufq_stack_t * Stack, bufq_entry_t * Entry);
+
+/* NULL if the stack is empty. */
+bufq_entry_t *
+bufq_stack_pop(bufq_stack_t * Stack);
+
+void
+bufq_table_insert(bufq_table_t * Table, bufq_entry_t * Entry, uint64_t Offset);
+
+/* NULL if there is no entry at Offset. */
+bufq_entry_t *
+bufq_table_find(bufq_table_t * Table, uint64_t Offset);
+
+/* Removes and returns the entry at Offset, NULL if there is none. */
+bufq_entry_t *
+bufq_table_remove(bufq_table_t * Table, uint64_t Offset);
+
+/* Removes and returns any entry, NULL if the table is empty. */
+bufq_entry_t *
+bufq_table_pop(bufq_table_t * Table);
+
+#endif /* BLACKPEARL_DSI_BUFQ_H */
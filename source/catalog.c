@@ -0,0 +1,247 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * System includes
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * DS3 includes
+ */
+#include <ds3.h>
+
+/*
+ * Local includes
+ */
+#include "catalog.h"
+#include "gds3.h"
+
+static size_t
+catalog_hash(const char * Name)
+{
+	size_t hash = 2166136261U;
+
+	for (; *Name; Name++)
+		hash = (hash ^ (unsigned char)*Name) * 16777619U;
+	return hash;
+}
+
+static void
+catalog_free_snapshot(catalog_snapshot_t * Snapshot)
+{
+	if (Snapshot)
+	{
+		ds3_free_service_response(Snapshot->Response);
+		free(Snapshot->Index);
+		free(Snapshot);
+	}
+}
+
+/* Takes ownership of Response. */
+static globus_result_t
+catalog_new_snapshot(catalog_t                * Catalog,
+                     ds3_get_service_response * Response,
+                     catalog_snapshot_t      ** Snapshot)
+{
+	catalog_snapshot_t * snapshot = NULL;
+	size_t               slot     = 0;
+	int                  i        = 0;
+
+	GlobusGFSName(catalog_new_snapshot);
+
+	*Snapshot = NULL;
+
+	snapshot = malloc(sizeof(catalog_snapshot_t));
+	if (!snapshot)
+	{
+		ds3_free_service_response(Response);
+		return GlobusGFSErrorMemory("catalog_snapshot_t");
+	}
+	memset(snapshot, 0, sizeof(catalog_snapshot_t));
+	snapshot->Response = Response;
+	snapshot->Fetched  = time(NULL);
+	snapshot->RefCnt   = 1; // The catalog's reference
+	snapshot->Lock     = &Catalog->Lock;
+
+	/* At most half full so probes stay short. */
+	snapshot->IndexSize = 16;
+	while (snapshot->IndexSize < Response->num_buckets * 2)
+		snapshot->IndexSize *= 2;
+
+	snapshot->Index = calloc(snapshot->IndexSize, sizeof(ds3_bucket *));
+	if (!snapshot->Index)
+	{
+		catalog_free_snapshot(snapshot);
+		return GlobusGFSErrorMemory("catalog index");
+	}
+
+	for (i = 0; i < Response->num_buckets; i++)
+	{
+		slot = catalog_hash(ds3_str_value(Response->buckets[i].name));
+		while (snapshot->Index[slot & (snapshot->IndexSize - 1)])
+			slot++;
+		snapshot->Index[slot & (snapshot->IndexSize - 1)] = &Response->buckets[i];
+	}
+
+	*Snapshot = snapshot;
+	return GLOBUS_SUCCESS;
+}
+
+/* Call with the catalog's lock held. */
+static void
+catalog_drop_current(catalog_t * Catalog)
+{
+	if (Catalog->Current && --Catalog->Current->RefCnt == 0)
+		catalog_free_snapshot(Catalog->Current);
+	Catalog->Current = NULL;
+}
+
+globus_result_t
+catalog_init(catalog_t * Catalog, ds3_get_service_response * Response)
+{
+	memset(Catalog, 0, sizeof(catalog_t));
+	pthread_mutex_init(&Catalog->Lock, NULL);
+
+	if (!Response)
+		return GLOBUS_SUCCESS;
+	return catalog_new_snapshot(Catalog, Response, &Catalog->Current);
+}
+
+void
+catalog_destroy(catalog_t * Catalog)
+{
+	pthread_mutex_lock(&Catalog->Lock);
+	catalog_drop_current(Catalog);
+	pthread_mutex_unlock(&Catalog->Lock);
+	pthread_mutex_destroy(&Catalog->Lock);
+}
+
+globus_result_t
+catalog_get(catalog_t           * Catalog,
+            ds3_client          * Client,
+            catalog_snapshot_t ** Snapshot)
+{
+	ds3_get_service_response * response = NULL;
+	catalog_snapshot_t       * snapshot = NULL;
+	globus_result_t            result   = GLOBUS_SUCCESS;
+
+	*Snapshot = NULL;
+
+	pthread_mutex_lock(&Catalog->Lock);
+	if (Catalog->Current && Catalog->Current->Fetched + CATALOG_MAX_AGE > time(NULL))
+	{
+		Catalog->Current->RefCnt++;
+		*Snapshot = Catalog->Current;
+	}
+	pthread_mutex_unlock(&Catalog->Lock);
+
+	if (*Snapshot)
+		return GLOBUS_SUCCESS;
+
+	/*
+	 * Fetch without the lock. Racing callers each fetch; the last one in
+	 * becomes current, and both answers are fresh.
+	 */
+	result = gds3_get_service(Client, &response);
+	if (result)
+		return result;
+
+	result = catalog_new_snapshot(Catalog, response, &snapshot);
+	if (result)
+		return result;
+
+	pthread_mutex_lock(&Catalog->Lock);
+	catalog_drop_current(Catalog);
+	Catalog->Current = snapshot;
+	snapshot->RefCnt++;
+	pthread_mutex_unlock(&Catalog->Lock);
+
+	*Snapshot = snapshot;
+	return GLOBUS_SUCCESS;
+}
+
+void
+catalog_release(catalog_snapshot_t * Snapshot)
+{
+	int ref_cnt = 0;
+
+	if (!Snapshot)
+		return;
+
+	pthread_mutex_lock(Snapshot->Lock);
+	ref_cnt = --Snapshot->RefCnt;
+	pthread_mutex_unlock(Snapshot->Lock);
+
+	if (ref_cnt == 0)
+		catalog_free_snapshot(Snapshot);
+}
+
+ds3_bucket *
+catalog_find_bucket(catalog_snapshot_t * Snapshot, const char * BucketName)
+{
+	ds3_bucket * bucket = NULL;
+	size_t       slot   = catalog_hash(BucketName);
+
+	while ((bucket = Snapshot->Index[slot & (Snapshot->IndexSize - 1)]))
+	{
+		if (strcmp(ds3_str_value(bucket->name), BucketName) == 0)
+			return bucket;
+		slot++;
+	}
+	return NULL;
+}
+
+void
+catalog_invalidate(catalog_t * Catalog)
+{
+	pthread_mutex_lock(&Catalog->Lock);
+	catalog_drop_current(Catalog);
+	pthread_mutex_unlock(&Catalog->Lock);
+}
@@ -0,0 +1,110 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * The session's view of its buckets: the get-service response plus a hash
+ * of the buckets by name. It is fetched on first use, refetched once it is
+ * CATALOG_MAX_AGE seconds old so buckets made elsewhere show up, and
+ * dropped when this session creates or deletes a bucket.
+ *
+ * Callers work on a snapshot, which stays valid until they release it even
+ * if the catalog moves on; a listing of '/' spans many stat replies.
+ */
+
+#ifndef BLACKPEARL_DSI_CATALOG_H
+#define BLACKPEARL_DSI_CATALOG_H
+
+/*
+ * System includes
+ */
+#include <pthread.h>
+#include <time.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * DS3 includes
+ */
+#include <ds3.h>
+
+#define CATALOG_MAX_AGE 30
+
+typedef struct {
+	ds3_get_service_response * Response;
+	ds3_bucket              ** Index;     // Open addressing by bucket name
+	size_t                     IndexSize; // Power of 2
+	time_t                     Fetched;
+	int                        RefCnt;    // Under the catalog's lock
+	pthread_mutex_t          * Lock;
+} catalog_snapshot_t;
+
+typedef struct {
+	pthread_mutex_t      Lock;
+	catalog_snapshot_t * Current; // NULL until needed
+} catalog_t;
+
+/* Takes ownership of Response, which may be NULL. */
+globus_result_t
+catalog_init(catalog_t * Catalog, ds3_get_service_response * Response);
+
+void
+catalog_destroy(catalog_t * Catalog);
+
+globus_result_t
+catalog_get(catalog_t           * Catalog,
+            ds3_client          * Client,
+            catalog_snapshot_t ** Snapshot);
+
+void
+catalog_release(catalog_snapshot_t * Snapshot);
+
+/* NULL if there is no such bucket. */
+ds3_bucket *
+catalog_find_bucket(catalog_snapshot_t * Snapshot, const char * BucketName);
+
+/* Call after creating or deleting a bucket. */
+void
+catalog_invalidate(catalog_t * Catalog);
+
+#endif /* BLACKPEARL_DSI_CATALOG_H */
@@ -63,6 +63,7 @@
 #include "retr.h"
 #include "gds3.h"
 #include "path.h"
+#include "workers.h"
 
 typedef struct {
 	ds3_client                 * Client;
@@ -138,6 +139,7 @@ cksm_thread(void * UserArg)
 		                            cksm_info->Object,
 		                            0,
 		                            cksm_info->Size,
+		                            IN_ORDER,
 		                            &bulk_response);
 
 		if (!result)
@@ -148,6 +150,8 @@ cksm_thread(void * UserArg)
 				                                 cksm_info->Bucket,
 				                                 cksm_info->Object,
 				                                 cksm_info->Offset,
+				                                 0,
+				                                 0,
 				                                 bulk_response->job_id->value,
 				                                 cksm_ds3_callback,
 				                                 cksm_info);
@@ -195,9 +199,6 @@ cksm(globus_gfs_operation_t      Operation,
 	char          * object_name = NULL;
 	char          * checksum    = NULL;
 	int             rc          = 0;
-	int             initted     = 0;
-	pthread_t       thread;
-	pthread_attr_t  attr;
 
 	GlobusGFSName(cksm);
 
@@ -218,8 +219,8 @@ cksm(globus_gfs_operation_t      Operation,
 		return;
 	}
 
-	// Shortcut
-	result = gds3_get_object(Client, bucket_name, object_name, &object);
+	// Shortcut. Not from the metadata cache; the checksum must be the BlackPearl's.
+	result = gds3_get_object_uncached(Client, bucket_name, object_name, &object);
 	if (!result && !object)
 		result = GlobusGFSErrorGeneric("No such object");
 	if (!result && object && object->etag && !strchr(object->etag->value, '-'))
@@ -273,20 +274,17 @@ cksm(globus_gfs_operation_t      Operation,
 	}
 
 	/*
-	 * Launch a detached thread.
+	 * Hand off to a worker.
 	 */
-	if ((rc = pthread_attr_init(&attr)) || !(initted = 1) ||
-	    (rc = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) ||
-	    (rc = pthread_create(&thread, &attr, cksm_thread, cksm_info)))
+	result = workers_submit(WORKERS_CKSM, cksm_thread, cksm_info);
+	if (result)
 	{
-		result = GlobusGFSErrorSystemError("Launching cksm object thread", rc);
+		result = GlobusGFSErrorWrapFailed("Launching cksm object thread", result);
 		Callback(Operation, result, NULL);
 
 		free(cksm_info->Bucket);
 		free(cksm_info->Object);
 		free(cksm_info);
 	}
-
-	if (initted) pthread_attr_destroy(&attr);
 }
 
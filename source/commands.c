@@ -57,6 +57,7 @@
 #include "path.h"
 #include "gds3.h"
 #include "cksm.h"
+#include "workers.h"
 
 globus_result_t
 commands_init(globus_gfs_operation_t Operation)
@@ -83,6 +84,7 @@ void
 commands_mkdir(globus_gfs_operation_t      Operation,
                globus_gfs_command_info_t * CommandInfo,
                ds3_client                * Client,
+               catalog_t                 * Catalog,
                commands_callback           Callback)
 {
 	globus_result_t result = GLOBUS_SUCCESS;
@@ -110,7 +112,7 @@ commands_mkdir(globus_gfs_operation_t      Operation,
 	 */
 	if (!object)
 	{
-		result = gds3_put_bucket(Client, bucket);
+		result = gds3_put_bucket(Client, Catalog, bucket);
 		Callback(Operation, result, NULL);
 		free(bucket);
 		return;
@@ -133,6 +135,7 @@ void
 commands_rmdir(globus_gfs_operation_t      Operation,
                globus_gfs_command_info_t * CommandInfo,
                ds3_client                * Client,
+               catalog_t                 * Catalog,
                commands_callback           Callback)
 {
 	globus_result_t result = GLOBUS_SUCCESS;
@@ -158,7 +161,7 @@ commands_rmdir(globus_gfs_operation_t      Operation,
 	 */
 	if (!folder)
 	{
-		result = gds3_delete_bucket(Client, bucket);
+		result = gds3_delete_bucket(Client, Catalog, bucket);
 		Callback(Operation, result, NULL);
 		free(bucket);
 		return;
@@ -177,6 +180,7 @@ void
 commands_unlink(globus_gfs_operation_t      Operation,
                 globus_gfs_command_info_t * CommandInfo,
                 ds3_client                * Client,
+                catalog_t                 * Catalog,
                 commands_callback           Callback)
 {
 	globus_result_t result = GLOBUS_SUCCESS;
@@ -206,10 +210,75 @@ commands_unlink(globus_gfs_operation_t      Operation,
 	free(object);
 }
 
+typedef void (*commands_func)(globus_gfs_operation_t      Operation,
+                              globus_gfs_command_info_t * CommandInfo,
+                              ds3_client                * Client,
+                              catalog_t                 * Catalog,
+                              commands_callback           Callback);
+
+typedef struct {
+	commands_func               Func;
+	globus_gfs_operation_t      Operation;
+	globus_gfs_command_info_t * CommandInfo;
+	ds3_client                * Client;
+	catalog_t                 * Catalog;
+	commands_callback           Callback;
+} commands_job_t;
+
+static void *
+commands_thread(void * UserArg)
+{
+	commands_job_t * job = UserArg;
+
+	job->Func(job->Operation, job->CommandInfo, job->Client, job->Catalog, job->Callback);
+	free(job);
+	return NULL;
+}
+
+/*
+ * Runs a command on a worker so the DS3 round trips do not hold up the
+ * server's thread.
+ */
+static void
+commands_submit(commands_func               Func,
+                globus_gfs_operation_t      Operation,
+                globus_gfs_command_info_t * CommandInfo,
+                ds3_client                * Client,
+                catalog_t                 * Catalog,
+                commands_callback           Callback)
+{
+	globus_result_t  result = GLOBUS_SUCCESS;
+	commands_job_t * job    = NULL;
+
+	GlobusGFSName(commands_submit);
+
+	job = malloc(sizeof(commands_job_t));
+	if (!job)
+	{
+		Callback(Operation, GlobusGFSErrorMemory("commands_job_t"), NULL);
+		return;
+	}
+
+	job->Func        = Func;
+	job->Operation   = Operation;
+	job->CommandInfo = CommandInfo;
+	job->Client      = Client;
+	job->Catalog     = Catalog;
+	job->Callback    = Callback;
+
+	result = workers_submit(WORKERS_COMMAND, commands_thread, job);
+	if (result)
+	{
+		free(job);
+		Callback(Operation, result, NULL);
+	}
+}
+
 void
 commands_run(globus_gfs_operation_t      Operation,
              globus_gfs_command_info_t * CommandInfo,
              ds3_client                * Client,
+             catalog_t                 * Catalog,
              commands_callback           Callback)
 {
 	GlobusGFSName(commands_run);
@@ -217,13 +286,13 @@ commands_run(globus_gfs_operation_t      Operation,
 	switch (CommandInfo->command)
 	{
 	case GLOBUS_GFS_CMD_MKD:
-		commands_mkdir(Operation, CommandInfo, Client, Callback);
+		commands_submit(commands_mkdir, Operation, CommandInfo, Client, Catalog, Callback);
 		break;
 	case GLOBUS_GFS_CMD_RMD:
-		commands_rmdir(Operation, CommandInfo, Client, Callback);
+		commands_submit(commands_rmdir, Operation, CommandInfo, Client, Catalog, Callback);
 		break;
 	case GLOBUS_GFS_CMD_DELE:
-		commands_unlink(Operation, CommandInfo, Client, Callback);
+		commands_submit(commands_unlink, Operation, CommandInfo, Client, Catalog, Callback);
 		break;
 
 	case GLOBUS_GFS_CMD_CKSM:
@@ -231,7 +300,7 @@ commands_run(globus_gfs_operation_t      Operation,
 		break;
 
 	case GLOBUS_GFS_HPSS_CMD_SITE_STAGE:
-		stage(Operation, CommandInfo, Client, Callback);
+		commands_submit(stage, Operation, CommandInfo, Client, Catalog, Callback);
 		break;
 
 	case GLOBUS_GFS_CMD_SITE_UTIME:       // No S3/DS3 support (need X attributes)
@@ -52,6 +52,11 @@
  */
 #include <ds3.h>
 
+/*
+ * Local includes
+ */
+#include "catalog.h"
+
 enum {
 	GLOBUS_GFS_HPSS_CMD_SITE_STAGE = GLOBUS_GFS_MIN_CUSTOM_CMD,
 };
@@ -67,6 +72,7 @@ void
 commands_run(globus_gfs_operation_t      Operation,
              globus_gfs_command_info_t * CommandInfo,
              ds3_client                * Client,
+             catalog_t                 * Catalog,
              commands_callback           Callback);
 
 #endif /* HPSS_DSI_COMMANDS_H */
@@ -43,6 +43,7 @@
  * System includes
  */
 #include <stdlib.h>
+#include <limits.h>
 
 /*
  * Globus includes
@@ -153,6 +154,90 @@ config_find_next_word(char *  Buffer,
 	}
 }
 
+/*
+ * Helper that converts a directive's value to a positive count.
+ */
+static globus_result_t
+config_parse_count(char * Value, int ValueLength, int * Count)
+{
+	char * value = NULL;
+	char * end   = NULL;
+	long   count = 0;
+
+	GlobusGFSName(config_parse_count);
+
+	value = strndup(Value, ValueLength);
+	if (!value)
+		return GlobusGFSErrorMemory("config value");
+
+	count = strtol(value, &end, 10);
+	if (*end != '\0' || count <= 0 || count > INT_MAX)
+	{
+		free(value);
+		return GlobusGFSErrorGeneric("Value must be a positive integer");
+	}
+
+	free(value);
+	*Count = count;
+	return GLOBUS_SUCCESS;
+}
+
+/*
+ * Helper that converts a directive's value to a size, like
+ * config_parse_count() but also taking 0.
+ */
+static globus_result_t
+config_parse_size(char * Value, int ValueLength, int * Size)
+{
+	char * value = NULL;
+	char * end   = NULL;
+	long   size  = 0;
+
+	GlobusGFSName(config_parse_size);
+
+	value = strndup(Value, ValueLength);
+	if (!value)
+		return GlobusGFSErrorMemory("config value");
+
+	size = strtol(value, &end, 10);
+	if (*end != '\0' || size < 0 || size > INT_MAX)
+	{
+		free(value);
+		return GlobusGFSErrorGeneric("Value must be zero or a positive integer");
+	}
+
+	free(value);
+	*Size = size;
+	return GLOBUS_SUCCESS;
+}
+
+/*
+ * Helper that converts a directive's value to 1 (yes/on/true) or 0 (no/off/false).
+ */
+static globus_result_t
+config_parse_bool(char * Value, int ValueLength, int * Bool)
+{
+	GlobusGFSName(config_parse_bool);
+
+	if ((ValueLength == 3 && strncasecmp(Value, "yes",   3) == 0) ||
+	    (ValueLength == 2 && strncasecmp(Value, "on",    2) == 0) ||
+	    (ValueLength == 4 && strncasecmp(Value, "true",  4) == 0))
+	{
+		*Bool = 1;
+		return GLOBUS_SUCCESS;
+	}
+
+	if ((ValueLength == 2 && strncasecmp(Value, "no",    2) == 0) ||
+	    (ValueLength == 3 && strncasecmp(Value, "off",   3) == 0) ||
+	    (ValueLength == 5 && strncasecmp(Value, "false", 5) == 0))
+	{
+		*Bool = 0;
+		return GLOBUS_SUCCESS;
+	}
+
+	return GlobusGFSErrorGeneric("Value must be yes or no");
+}
+
 static globus_result_t
 config_parse_config_file(config_t * Config, char * ConfigFilePath)
 {
@@ -212,6 +297,126 @@ config_parse_config_file(config_t * Config, char * ConfigFilePath)
                    strncasecmp(key, "AccessIDFile", key_length) == 0)
         {
             Config->AccessIDFile = strndup(value, value_length);
+        } else if (key_length == strlen("JournalDir") &&
+                   strncasecmp(key, "JournalDir", key_length) == 0)
+        {
+            Config->JournalDir = strndup(value, value_length);
+        } else if (key_length == strlen("MetadataCacheFile") &&
+                   strncasecmp(key, "MetadataCacheFile", key_length) == 0)
+        {
+            Config->MetadataCacheFile = strndup(value, value_length);
+        } else if (key_length == strlen("MetadataCacheTTL") &&
+                   strncasecmp(key, "MetadataCacheTTL", key_length) == 0)
+        {
+            result = config_parse_count(value, value_length, &Config->MetadataCacheTTL);
+            if (result != GLOBUS_SUCCESS)
+            {
+                result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+                goto cleanup;
+            }
+        } else if (key_length == strlen("StorStreams") &&
+                   strncasecmp(key, "StorStreams", key_length) == 0)
+        {
+            result = config_parse_count(value, value_length, &Config->StorStreams);
+            if (result != GLOBUS_SUCCESS)
+            {
+                result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+                goto cleanup;
+            }
+        } else if (key_length == strlen("RetrStreams") &&
+                   strncasecmp(key, "RetrStreams", key_length) == 0)
+        {
+            result = config_parse_count(value, value_length, &Config->RetrStreams);
+            if (result != GLOBUS_SUCCESS)
+            {
+                result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+                goto cleanup;
+            }
+        } else if (key_length == strlen("AllocateTimeout") &&
+                   strncasecmp(key, "AllocateTimeout", key_length) == 0)
+        {
+            result = config_parse_count(value, value_length, &Config->AllocateTimeout);
+            if (result != GLOBUS_SUCCESS)
+            {
+                result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+                goto cleanup;
+            }
+        } else if (key_length == strlen("BufferBudget") &&
+                   strncasecmp(key, "BufferBudget", key_length) == 0)
+        {
+            result = config_parse_count(value, value_length, &Config->BufferBudget);
+            if (result != GLOBUS_SUCCESS)
+            {
+                result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+                goto cleanup;
+            }
+        } else if (key_length == strlen("BufferBudgetFile") &&
+                   strncasecmp(key, "BufferBudgetFile", key_length) == 0)
+        {
+            Config->BufferBudgetFile = strndup(value, value_length);
+        } else if (key_length == strlen("SmallObjectSize") &&
+                   strncasecmp(key, "SmallObjectSize", key_length) == 0)
+        {
+            result = config_parse_size(value, value_length, &Config->SmallObjectSize);
+            if (result != GLOBUS_SUCCESS)
+            {
+                result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+                goto cleanup;
+            }
+        } else if (key_length == strlen("BufferHugePages") &&
+                   strncasecmp(key, "BufferHugePages", key_length) == 0)
+        {
+            result = config_parse_bool(value, value_length, &Config->BufferHugePages);
+            if (result != GLOBUS_SUCCESS)
+            {
+                result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+                goto cleanup;
+            }
+        } else if (key_length == strlen("Workers") &&
+                   strncasecmp(key, "Workers", key_length) == 0)
+        {
+            result = config_parse_count(value, value_length, &Config->Workers);
+            if (result != GLOBUS_SUCCESS)
+            {
+                result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+                goto cleanup;
+            }
+        } else if (key_length == strlen("StorWorkers") &&
+                   strncasecmp(key, "StorWorkers", key_length) == 0)
+        {
+            result = config_parse_count(value, value_length, &Config->TypeWorkers[WORKERS_STOR]);
+            if (result != GLOBUS_SUCCESS)
+            {
+                result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+                goto cleanup;
+            }
+        } else if (key_length == strlen("RetrWorkers") &&
+                   strncasecmp(key, "RetrWorkers", key_length) == 0)
+        {
+            result = config_parse_count(value, value_length, &Config->TypeWorkers[WORKERS_RETR]);
+            if (result != GLOBUS_SUCCESS)
+            {
+                result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+                goto cleanup;
+            }
+        } else if (key_length == strlen("CksmWorkers") &&
+                   strncasecmp(key, "CksmWorkers", key_length) == 0)
+        {
+            result = config_parse_count(value, value_length, &Config->TypeWorkers[WORKERS_CKSM]);
+            if (result != GLOBUS_SUCCESS)
+            {
+                result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+                goto cleanup;
+            }
+        } else if (key_length == strlen("CommandWorkers") &&
+                   strncasecmp(key, "CommandWorkers", key_length) == 0)
+        {
+            result = config_parse_count(value, value_length, &Config->TypeWorkers[WORKERS_COMMAND]);
+            if (result != GLOBUS_SUCCESS)
+            {
+                result = GlobusGFSErrorWrapFailed("Parsing config options", result);
+                goto cleanup;
+            }
         } else
         {
             result = GlobusGFSErrorWrapFailed("Parsing config options", GlobusGFSErrorGeneric(buffer));
@@ -239,6 +444,12 @@ config_init(config_t ** Config)
     if (!*Config)
         return GlobusGFSErrorMemory("config_t");
     memset(*Config, 0, sizeof(config_t));
+    (*Config)->StorStreams = DEFAULT_STOR_STREAMS;
+    (*Config)->RetrStreams = DEFAULT_RETR_STREAMS;
+    (*Config)->AllocateTimeout = DEFAULT_ALLOCATE_TIMEOUT;
+    (*Config)->SmallObjectSize = DEFAULT_SMALL_OBJECT_SIZE;
+    (*Config)->MetadataCacheTTL = DEFAULT_METADATA_CACHE_TTL;
+    (*Config)->Workers = WORKERS_DEFAULT_MAX;
 
     /* Find the config file. */
     result = config_find_config_file(&config_file_path);
@@ -264,6 +475,12 @@ config_destroy(config_t * Config)
             globus_free(Config->EndPoint);
         if (Config->AccessIDFile)
             globus_free(Config->AccessIDFile);
+        if (Config->JournalDir)
+            globus_free(Config->JournalDir);
+        if (Config->MetadataCacheFile)
+            globus_free(Config->MetadataCacheFile);
+        if (Config->BufferBudgetFile)
+            globus_free(Config->BufferBudgetFile);
 
         globus_free(Config);
     }
@@ -47,12 +47,40 @@
  */
 #include <globus_gridftp_server.h>
 
+/*
+ * Local includes
+ */
+#include "workers.h"
+
 #define DEFAULT_CONFIG_FILE   "/etc/blackpearl/GridFTPConfig"
 
+/* Most chunks uploaded at once per STOR. */
+#define DEFAULT_STOR_STREAMS  8
+/* Most chunks retrieved at once per RETR. */
+#define DEFAULT_RETR_STREAMS  8
+/* Seconds a STOR waits for cache space before failing. */
+#define DEFAULT_ALLOCATE_TIMEOUT 3600
+/* KB at or below which objects skip the bulk job machinery. */
+#define DEFAULT_SMALL_OBJECT_SIZE 1024
+/* Seconds a metadata cache entry is trusted. */
+#define DEFAULT_METADATA_CACHE_TTL 30
+
 typedef struct config {
 	char * ConfigFilePath;
     char * EndPoint;
     char * AccessIDFile;
+    int    StorStreams;
+    int    RetrStreams;
+    int    AllocateTimeout;
+    int    BufferHugePages;
+    int    BufferBudget;    // MB for all transfers sharing it, 0 = unlimited
+    char * BufferBudgetFile; // NULL keeps the budget per process
+    int    SmallObjectSize; // KB, 0 = always use bulk jobs
+    int    Workers;
+    int    TypeWorkers[WORKERS_TYPE_CNT]; // 0 = no limit beyond Workers
+    char * JournalDir;   // NULL disables the STOR restart journal
+    char * MetadataCacheFile; // NULL disables the metadata cache
+    int    MetadataCacheTTL;  // Seconds
 } config_t;
 
 globus_result_t
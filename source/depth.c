@@ -0,0 +1,235 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * System includes
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * Local includes
+ */
+#include "depth.h"
+
+static uint64_t
+depth_usec_between(struct timespec * Start, struct timespec * End)
+{
+	return (uint64_t)(End->tv_sec - Start->tv_sec) * 1000000 +
+	       (End->tv_nsec - Start->tv_nsec) / 1000;
+}
+
+void
+depth_init(depth_t * Depth, int Start)
+{
+	memset(Depth, 0, sizeof(depth_t));
+
+	if (Start < DEPTH_MIN) Start = DEPTH_MIN;
+	if (Start > DEPTH_MAX) Start = DEPTH_MAX;
+
+	Depth->Target = Start;
+	Depth->Start  = Start;
+	Depth->Low    = Start;
+	Depth->High   = Start;
+
+	clock_gettime(CLOCK_MONOTONIC, &Depth->Begin);
+	Depth->IntervalStart = Depth->Begin;
+}
+
+static void
+depth_move(depth_t         * Depth,
+           int               To,
+           struct timespec * Now,
+           uint64_t          FillRate,
+           uint64_t          DrainRate)
+{
+	depth_step_t * step = &Depth->Steps[Depth->StepCnt % DEPTH_TRACE_CNT];
+
+	step->Msec      = depth_usec_between(&Depth->Begin, Now) / 1000;
+	step->From      = Depth->Target;
+	step->To        = To;
+	step->FillRate  = FillRate;
+	step->DrainRate = DrainRate;
+	Depth->StepCnt++;
+
+	Depth->Target = To;
+	if (To < Depth->Low)  Depth->Low  = To;
+	if (To > Depth->High) Depth->High = To;
+}
+
+static void
+depth_update(depth_t * Depth)
+{
+	struct timespec now;
+	uint64_t        usec       = 0;
+	uint64_t        fill_rate  = 0;
+	uint64_t        drain_rate = 0;
+	int             move       = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	usec = depth_usec_between(&Depth->IntervalStart, &now);
+	if (usec < DEPTH_INTERVAL)
+		return;
+
+	fill_rate  = Depth->Filled  * 1000000 / usec;
+	drain_rate = Depth->Drained * 1000000 / usec;
+
+	/* An idle interval (waiting on DS3 allocations, say) says nothing. */
+	if (!Depth->Drained)
+		goto next;
+
+	if (Depth->LastMove > 0 &&
+	    drain_rate * 100 < Depth->LastRate * (100 + DEPTH_GAIN))
+	{
+		/* Deeper did not help. */
+		depth_move(Depth, Depth->Target - 1, &now, fill_rate, drain_rate);
+		Depth->Hold     = DEPTH_HOLD;
+		Depth->LastMove = 0;
+		goto next;
+	}
+
+	if (Depth->LastMove < 0 &&
+	    drain_rate * 100 < Depth->LastRate * (100 - DEPTH_GAIN))
+	{
+		/* Shallower hurt. */
+		depth_move(Depth, Depth->Target + 1, &now, fill_rate, drain_rate);
+		Depth->Hold     = DEPTH_HOLD;
+		Depth->LastMove = 0;
+		goto next;
+	}
+
+	Depth->LastMove = 0;
+	if (Depth->Hold)
+	{
+		Depth->Hold--;
+		goto next;
+	}
+
+	if (Depth->Stalls && !Depth->Capped && Depth->Target < DEPTH_MAX)
+		move = 1;
+	else if (!Depth->Stalls && Depth->Target > DEPTH_MIN)
+		move = -1;
+
+	if (move)
+	{
+		depth_move(Depth, Depth->Target + move, &now, fill_rate, drain_rate);
+		Depth->LastMove = move;
+		Depth->LastRate = drain_rate;
+	}
+
+next:
+	Depth->IntervalStart = now;
+	Depth->Filled        = 0;
+	Depth->Drained       = 0;
+	Depth->Stalls        = 0;
+	Depth->Capped        = 0;
+}
+
+void
+depth_filled(depth_t * Depth, uint64_t Bytes)
+{
+	Depth->Filled += Bytes;
+	depth_update(Depth);
+}
+
+void
+depth_drained(depth_t * Depth, uint64_t Bytes)
+{
+	Depth->Drained += Bytes;
+	depth_update(Depth);
+}
+
+void
+depth_stalled(depth_t * Depth, int Capped)
+{
+	Depth->Stalls++;
+	Depth->TotalStalls++;
+	if (Capped)
+		Depth->Capped = 1;
+}
+
+void
+depth_log(depth_t * Depth, const char * Name, const char * Path)
+{
+	depth_step_t * step  = NULL;
+	char           trace[DEPTH_TRACE_CNT * 48 + 1];
+	int            first = 0;
+	int            used  = 0;
+	int            i     = 0;
+
+	trace[0] = '\0';
+
+	if (Depth->StepCnt > DEPTH_TRACE_CNT)
+		first = Depth->StepCnt - DEPTH_TRACE_CNT;
+
+	for (i = first; i < Depth->StepCnt && used < sizeof(trace); i++)
+	{
+		step = &Depth->Steps[i % DEPTH_TRACE_CNT];
+		used += snprintf(trace + used,
+		                 sizeof(trace) - used,
+		                 " %u.%03us:%d->%d(%llu/%llu)",
+		                 step->Msec / 1000,
+		                 step->Msec % 1000,
+		                 step->From,
+		                 step->To,
+		                 (unsigned long long)step->FillRate,
+		                 (unsigned long long)step->DrainRate);
+	}
+
+	globus_gfs_log_message(GLOBUS_GFS_LOG_INFO,
+	                       "BlackPearl %s %s: buffer depth %d to %d (low %d, high %d), "
+	                       "%llu stalls, %d moves; trace (fill/drain bytes/sec):%s\n",
+	                       Name,
+	                       Path,
+	                       Depth->Start,
+	                       Depth->Target,
+	                       Depth->Low,
+	                       Depth->High,
+	                       (unsigned long long)Depth->TotalStalls,
+	                       Depth->StepCnt,
+	                       trace);
+}
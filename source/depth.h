@@ -0,0 +1,121 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * Per-transfer buffer depth controller. STOR and RETR keep Target buffers
+ * outstanding between the GridFTP data channels and the DS3 streams. The
+ * transfer reports bytes as they are filled and drained and every time the
+ * draining side runs dry; once per interval, the controller moves Target by
+ * one buffer and keeps the move only if throughput follows:
+ *
+ *  - the draining side ran dry: try one buffer deeper and keep it if the
+ *    drain rate rises by DEPTH_GAIN percent.
+ *  - it never ran dry: try one buffer shallower and keep it unless the drain
+ *    rate falls by DEPTH_GAIN percent.
+ *
+ * A rejected move is undone and the controller holds for DEPTH_HOLD
+ * intervals. Target never grows while the transfer is over its share of
+ * the buffer budget. Moves are kept in a short trace logged at the end.
+ */
+
+#ifndef BLACKPEARL_DSI_DEPTH_H
+#define BLACKPEARL_DSI_DEPTH_H
+
+/*
+ * System includes
+ */
+#include <stdint.h>
+#include <time.h>
+
+#define DEPTH_MIN        1
+#define DEPTH_MAX        64
+#define DEPTH_INTERVAL   1000000 // usec
+#define DEPTH_GAIN       5       // percent
+#define DEPTH_HOLD       10      // intervals
+#define DEPTH_TRACE_CNT  32
+
+typedef struct {
+	uint32_t Msec;      // Since the transfer started
+	int      From;
+	int      To;
+	uint64_t FillRate;  // bytes/sec over the interval
+	uint64_t DrainRate; // bytes/sec over the interval
+} depth_step_t;
+
+typedef struct {
+	int Target; // Buffers to keep outstanding
+	int Start;
+	int Low;
+	int High;
+
+	struct timespec Begin;
+	struct timespec IntervalStart;
+	uint64_t        Filled;   // Bytes this interval
+	uint64_t        Drained;  // Bytes this interval
+	uint64_t        Stalls;   // Times the draining side ran dry this interval
+	int             Capped;   // Over budget this interval
+	int             LastMove; // +1, -1 or 0 for the previous interval
+	uint64_t        LastRate; // Drain rate before the previous move
+	int             Hold;
+
+	uint64_t        TotalStalls;
+	int             StepCnt;
+	depth_step_t    Steps[DEPTH_TRACE_CNT]; // The last DEPTH_TRACE_CNT moves
+} depth_t;
+
+void
+depth_init(depth_t * Depth, int Start);
+
+void
+depth_filled(depth_t * Depth, uint64_t Bytes);
+
+void
+depth_drained(depth_t * Depth, uint64_t Bytes);
+
+/* Capped = the transfer is over its share of the buffer budget. */
+void
+depth_stalled(depth_t * Depth, int Capped);
+
+/* Logs the summary and the trace, prefixed by Name and Path. */
+void
+depth_log(depth_t * Depth, const char * Name, const char * Path);
+
+#endif /* BLACKPEARL_DSI_DEPTH_H */
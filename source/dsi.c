@@ -61,6 +61,11 @@
 #include "stor.h"
 #include "retr.h"
 #include "gds3.h"
+#include "session.h"
+#include "pool.h"
+#include "governor.h"
+#include "workers.h"
+#include "mdcache.h"
 
 /* This is used to define the debug print statements. */
 GlobusDebugDefine(GLOBUS_GRIDFTP_SERVER_BLACKPEARL);
@@ -71,10 +76,14 @@ dsi_init(globus_gfs_operation_t      Operation,
 {
 	config_t      * config     = NULL;
 	globus_result_t result     = GLOBUS_SUCCESS;
+	globus_result_t cache_result = GLOBUS_SUCCESS;
+	globus_result_t budget_result = GLOBUS_SUCCESS;
 	char          * access_id  = NULL;
 	char          * secret_key = NULL;
 	ds3_creds     * bp_creds   = NULL;
 	ds3_client    * bp_client  = NULL;
+	session_t     * session    = NULL;
+	ds3_get_service_response * response = NULL;
 
 	GlobusGFSName(dsi_init);
 
@@ -107,14 +116,58 @@ dsi_init(globus_gfs_operation_t      Operation,
 		goto cleanup;
 	}
 
-	/* Test the credentials with a get-service call. */
-	ds3_get_service_response * response = NULL;
+	/* Test the credentials with a get-service call; it seeds the catalog. */
 	result = gds3_get_service(bp_client, &response);
-	ds3_free_service_response(response);
 	if (result)
 		goto cleanup;
 
 	result = commands_init(Operation);
+	if (result != GLOBUS_SUCCESS)
+		goto cleanup;
+
+	session = globus_malloc(sizeof(session_t));
+	if (!session)
+	{
+		result = GlobusGFSErrorMemory("session_t");
+		goto cleanup;
+	}
+	session->Client = bp_client;
+	session->Config = config;
+
+	result = catalog_init(&session->Catalog, response);
+	response = NULL;
+	if (result != GLOBUS_SUCCESS)
+	{
+		globus_free(session);
+		session = NULL;
+		goto cleanup;
+	}
+
+	pool_set_huge_pages(config->BufferHugePages);
+	governor_set_budget((uint64_t)config->BufferBudget * 1024 * 1024);
+	workers_set_limits(config->Workers, config->TypeWorkers);
+
+	/* Without the file, the budget still holds within this process. */
+	budget_result = governor_init(config->BufferBudgetFile, SessionInfo->username);
+	if (budget_result != GLOBUS_SUCCESS)
+	{
+		globus_gfs_log_result(GLOBUS_GFS_LOG_WARN,
+		                      "BlackPearl buffer budget is per process",
+		                      budget_result);
+		globus_object_free(globus_error_get(budget_result));
+	}
+
+	/* The session works without the cache, just slower. */
+	cache_result = mdcache_init(config->MetadataCacheFile,
+	                            SessionInfo->username,
+	                            config->MetadataCacheTTL);
+	if (cache_result != GLOBUS_SUCCESS)
+	{
+		globus_gfs_log_result(GLOBUS_GFS_LOG_WARN,
+		                      "BlackPearl metadata cache disabled",
+		                      cache_result);
+		globus_object_free(globus_error_get(cache_result));
+	}
 
 cleanup:
 	/*
@@ -128,16 +181,17 @@ cleanup:
 	 */
 	globus_gridftp_server_finished_session_start(Operation,
 	                                             result,
-	                                             bp_client, // Session variable
+	                                             session,   // Session variable
 	                                             NULL,      // username
 	                                             "/");      // home directory
 
-	config_destroy(config);
 	if (access_id)  globus_free(access_id);
 	if (secret_key) globus_free(secret_key);
 
 	if (result != GLOBUS_SUCCESS)
 	{
+		ds3_free_service_response(response);
+		config_destroy(config);
 		ds3_free_creds(bp_creds);
 		ds3_free_client(bp_client);
 	}
@@ -146,50 +200,70 @@ cleanup:
 void
 dsi_destroy(void * Arg)
 {
-	ds3_client * bp_client = Arg;
-	if (bp_client)
+	session_t      * session = Arg;
+	pool_stats_t     stats;
+	governor_stats_t governor;
+	workers_stats_t  workers;
+	mdcache_stats_t  mdcache;
+
+	if (session)
 	{
-		ds3_free_creds(bp_client->creds);
-		ds3_free_client(bp_client);
+		pool_get_stats(&stats);
+		globus_gfs_log_message(GLOBUS_GFS_LOG_INFO,
+		                       "BlackPearl buffer pool: %llu hits, %llu misses, "
+		                       "%llu bytes cached, %llu bytes in use\n",
+		                       (unsigned long long)stats.Hits,
+		                       (unsigned long long)stats.Misses,
+		                       (unsigned long long)stats.CachedBytes,
+		                       (unsigned long long)stats.InUseBytes);
+
+		governor_get_stats(&governor);
+		globus_gfs_log_message(GLOBUS_GFS_LOG_INFO,
+		                       "BlackPearl buffer budget: %llu bytes, high water %llu bytes, "
+		                       "high water %llu transfers, %llu buffers delayed\n",
+		                       (unsigned long long)governor.Budget,
+		                       (unsigned long long)governor.HighWater,
+		                       (unsigned long long)governor.HighWaterTransfers,
+		                       (unsigned long long)governor.Delays);
+
+		workers_get_stats(&workers);
+		globus_gfs_log_message(GLOBUS_GFS_LOG_INFO,
+		                       "BlackPearl workers: %llu threads, %llu jobs, %llu queued, "
+		                       "high water %llu queued, average wait %llu us, max wait %llu us\n",
+		                       (unsigned long long)workers.Threads,
+		                       (unsigned long long)workers.Jobs,
+		                       (unsigned long long)workers.Queued,
+		                       (unsigned long long)workers.QueuedHighWater,
+		                       (unsigned long long)(workers.Jobs ? workers.WaitUsec / workers.Jobs : 0),
+		                       (unsigned long long)workers.MaxWaitUsec);
+
+		if (mdcache_get_stats(&mdcache))
+			globus_gfs_log_message(GLOBUS_GFS_LOG_INFO,
+			                       "BlackPearl metadata cache: %llu hits, %llu misses, "
+			                       "%llu stale, %llu inserts, %llu invalidations, %llu flushes\n",
+			                       (unsigned long long)mdcache.Hits,
+			                       (unsigned long long)mdcache.Misses,
+			                       (unsigned long long)mdcache.Stale,
+			                       (unsigned long long)mdcache.Inserts,
+			                       (unsigned long long)mdcache.Invalidations,
+			                       (unsigned long long)mdcache.Flushes);
+
+		catalog_destroy(&session->Catalog);
+		ds3_free_creds(session->Client->creds);
+		ds3_free_client(session->Client);
+		config_destroy(session->Config);
+		globus_free(session);
 	}
 }
 
-int
-dsi_partial_transfer(globus_gfs_transfer_info_t * TransferInfo)
-{
-	return (TransferInfo->partial_offset  != 0 || TransferInfo->partial_length != -1);
-}
-
-int
-dsi_restart_transfer(globus_gfs_transfer_info_t * TransferInfo)
-{
-	globus_off_t offset;
-	globus_off_t length;
-
-	if (globus_range_list_size(TransferInfo->range_list) != 1)
-		return 1;
-
-	globus_range_list_at(TransferInfo->range_list, 0, &offset, &length);
-	return (offset != 0 || length != -1);
-}
-
 void
 dsi_send(globus_gfs_operation_t       Operation,
          globus_gfs_transfer_info_t * TransferInfo,
          void                       * UserArg)
 {
-	globus_result_t result = GLOBUS_SUCCESS;
-
-	GlobusGFSName(dsi_send);
-
-	if (dsi_partial_transfer(TransferInfo) || dsi_restart_transfer(TransferInfo))
-	{
-		result = GlobusGFSErrorGeneric("Non-zero offsets are not supported");
-		globus_gridftp_server_finished_transfer(Operation, result);
-		return;
-	}
+	session_t * session = UserArg;
 
-	retr(UserArg, Operation, TransferInfo);
+	retr(session->Client, session->Config, Operation, TransferInfo);
 }
 
 void
@@ -197,7 +271,9 @@ dsi_recv(globus_gfs_operation_t       Operation,
          globus_gfs_transfer_info_t * TransferInfo,
          void                       * UserArg)
 {
-	stor(UserArg, Operation, TransferInfo);
+	session_t * session = UserArg;
+
+	stor(session->Client, session->Config, Operation, TransferInfo);
 }
 
 void
@@ -205,31 +281,54 @@ dsi_command(globus_gfs_operation_t      Operation,
             globus_gfs_command_info_t * CommandInfo,
             void                      * UserArg)
 {
-	commands_run(Operation, CommandInfo, UserArg, globus_gridftp_server_finished_command);
+	session_t * session = UserArg;
+
+	commands_run(Operation,
+	             CommandInfo,
+	             session->Client,
+	             &session->Catalog,
+	             globus_gridftp_server_finished_command);
 }
 
-#define STAT_ENTRIES_PER_REPLY 200
+/*
+ * Replies go out once they reach about STAT_REPLY_BYTES, so clients see a
+ * steady stream whatever the name lengths; STAT_ENTRIES_PER_REPLY only caps
+ * the array.
+ */
+#define STAT_REPLY_BYTES       (64*1024)
+#define STAT_ENTRIES_PER_REPLY 1024
 
 void
 dsi_stat(globus_gfs_operation_t   Operation,
          globus_gfs_stat_info_t * StatInfo,
          void                   * Arg)
 {
-	globus_result_t   result = GLOBUS_SUCCESS;
-	ds3_client      * client = Arg;
-	stat_state_t      state;
-	globus_gfs_stat_t gfs_stat_array[STAT_ENTRIES_PER_REPLY];
-	int               stat_count;
+	globus_result_t     result = GLOBUS_SUCCESS;
+	session_t         * session = Arg;
+	ds3_client        * client  = session->Client;
+	stat_state_t        state;
+	globus_gfs_stat_t * gfs_stat_array = NULL;
+	int                 stat_count = 0;
 
 	GlobusGFSName(dsi_stat);
 
+	gfs_stat_array = malloc(STAT_ENTRIES_PER_REPLY * sizeof(globus_gfs_stat_t));
+	if (!gfs_stat_array)
+	{
+		result = GlobusGFSErrorMemory("globus_gfs_stat_t");
+		globus_gridftp_server_finished_stat(Operation, result, NULL, 0);
+		return;
+	}
+
 	stat_init_state(&state);
 
 	do {
 		result = stat_entries(client,
+		                      &session->Catalog,
 		                      StatInfo->pathname,
 		                      StatInfo->file_only,
 		                      STAT_ENTRIES_PER_REPLY,
+		                      STAT_REPLY_BYTES,
 		                      gfs_stat_array,
 		                      &stat_count,
 		                      &state);
@@ -250,6 +349,7 @@ dsi_stat(globus_gfs_operation_t   Operation,
 	} while (!stat_is_complete(&state) && result == GLOBUS_SUCCESS);
 
 	stat_destroy_state(&state);
+	free(gfs_stat_array);
 }
 
 globus_gfs_storage_iface_t blackpearl_dsi_iface =
@@ -39,9 +39,6 @@
  * DEALINGS WITH THE SOFTWARE.
  */
 
-#ifndef BLACKPEARL_DSI_ERROR_H
-#define BLACKPEARL_DSI_ERROR_H
-
 /*
  * Globus includes
  */
@@ -52,6 +49,11 @@
  */
 #include <ds3.h>
 
+/*
+ * Local includes
+ */
+#include "error.h"
+
 globus_result_t
 error_translate(ds3_error * Error)
 {
@@ -65,6 +67,15 @@ error_translate(ds3_error * Error)
 	switch (Error->code)
 	{
 	case DS3_ERROR_BAD_STATUS_CODE:
+		if (Error->error && Error->error->status_code == 503)
+			return globus_error_put(globus_error_construct_error(GLOBUS_NULL,
+			                                                     GLOBUS_NULL,
+			                                                     ERROR_DS3_BUSY,
+			                                                     __FILE__,
+			                                                     _gfs_name,
+			                                                     __LINE__,
+			                                                     "%s",
+			                                                     ds3_str_value(Error->error->error_body)));
 		//return GlobusGFSErrorGeneric(ds3_str_value(Error->error->status_message));
 		return GlobusGFSErrorGeneric(ds3_str_value(Error->error->error_body));
 	case DS3_ERROR_TOO_MANY_REDIRECTS:
@@ -101,4 +112,14 @@ error_translate(ds3_error * Error)
 	return GlobusGFSErrorGeneric("An unknown DS3 error has occurred");
 }
 
-#endif /* BLACKPEARL_DSI_ERROR_H */
+int
+error_is_busy(globus_result_t Result)
+{
+	globus_object_t * error = NULL;
+
+	if (Result == GLOBUS_SUCCESS)
+		return 0;
+
+	error = globus_error_peek(Result);
+	return (error && globus_error_get_type(error) == ERROR_DS3_BUSY);
+}
@@ -52,7 +52,14 @@
  */
 #include <ds3.h>
 
+/* Error type for a 503 from the BlackPearl; the request may be retried. */
+#define ERROR_DS3_BUSY 503
+
 globus_result_t
 error_translate(ds3_error * Error);
 
+/* 1 = Result is a 503 from the BlackPearl. */
+int
+error_is_busy(globus_result_t Result);
+
 #endif /* BLACKPEARL_DSI_ERROR_H */
@@ -54,6 +54,7 @@
  */
 #include "gds3.h"
 #include "error.h"
+#include "mdcache.h"
 
 globus_result_t
 gds3_get_service(ds3_client * Client, ds3_get_service_response ** Response)
@@ -106,8 +107,44 @@ gds3_get_bucket(ds3_client              *  Client,
 	return GLOBUS_SUCCESS;
 }
 
+/*
+ * The SDK only hands back bucket listings as a parsed tree. A GET of the
+ * bucket path with the listing parameters is the same request, and going
+ * through ds3_get_object() lets us stream the body.
+ */
 globus_result_t
-gds3_put_bucket(ds3_client * Client, char * BucketName)
+gds3_stream_bucket(ds3_client * Client,
+                   char       * BucketName,
+                   char       * Delimiter,
+                   char       * Prefix,
+                   char       * Marker,
+                   uint32_t     MaxKeys,
+                   size_t    (* BufferCallout)(void*, size_t, size_t, void*),
+                   void       * BufferCalloutArg)
+{
+	globus_result_t   result  = GLOBUS_SUCCESS;
+	ds3_request     * request = NULL;
+	ds3_error       * error   = NULL;
+
+	request = ds3_init_get_object(BucketName, "", 0);
+	if (Delimiter)
+		ds3_request_set_delimiter(request, Delimiter);
+	if (Prefix)
+		ds3_request_set_prefix(request, Prefix);
+	if (Marker)
+		ds3_request_set_marker(request, Marker);
+	if (MaxKeys > 0)
+		ds3_request_set_max_keys(request, MaxKeys);
+
+	error   = ds3_get_object(Client, request, BufferCalloutArg, BufferCallout);
+	result  = error_translate(error);
+	ds3_free_request(request);
+	ds3_free_error(error);
+	return result;
+}
+
+globus_result_t
+gds3_put_bucket(ds3_client * Client, catalog_t * Catalog, char * BucketName)
 {
 	globus_result_t   result  = GLOBUS_SUCCESS;
 	ds3_request     * request = NULL;
@@ -116,56 +153,150 @@ gds3_put_bucket(ds3_client * Client, char * BucketName)
 	request = ds3_init_put_bucket(BucketName);
 	error   = ds3_put_bucket(Client, request);
 	result  = error_translate(error);
+	catalog_invalidate(Catalog);
 	ds3_free_error(error);
 	ds3_free_request(request);
 	return result;
 }
 
+/*
+ * Keys are listed in byte order and a name sorts before every longer key
+ * that starts with it, so the first key under the prefix ObjectName is
+ * ObjectName itself if the object exists. One request, however many keys
+ * share the prefix.
+ */
+globus_result_t
+gds3_get_object_uncached(ds3_client *  Client,
+                         char       *  BucketName,
+                         char       *  ObjectName,
+                         ds3_object ** Object)
+{
+	ds3_get_bucket_response * response = NULL;
+	globus_result_t           result   = GLOBUS_SUCCESS;
+	mdcache_info_t            info;
+	ds3_object              * object   = NULL;
+
+	*Object = NULL;
+
+	result = gds3_get_bucket(Client,
+	                         BucketName,
+	                         &response,
+	                         NULL,       // Delimiter
+	                         ObjectName, // Prefix
+	                         NULL,       // Marker
+	                         1);         // MaxKeys
+	if (result)
+		return result;
+
+	if (response->num_objects > 0 &&
+	    strcmp(ds3_str_value(response->objects[0].name), ObjectName) == 0)
+	{
+		object = &response->objects[0];
+		*Object = gds3_copy_object(object);
+
+		/* Misses are not cached; a STOR from elsewhere could create it. */
+		memset(&info, 0, sizeof(info));
+		info.Type = MDCACHE_OBJECT;
+		info.Size = object->size;
+		if ((!object->etag || object->etag->size < sizeof(info.ETag)) &&
+		    (!object->last_modified || object->last_modified->size < sizeof(info.LastModified)))
+		{
+			if (object->etag)
+				strcpy(info.ETag, object->etag->value);
+			if (object->last_modified)
+				strcpy(info.LastModified, object->last_modified->value);
+			mdcache_insert(Client, BucketName, ObjectName, &info);
+		}
+	}
+
+	ds3_free_bucket_response(response);
+	return GLOBUS_SUCCESS;
+}
+
 globus_result_t
 gds3_get_object(ds3_client *  Client,
                 char       *  BucketName,
                 char       *  ObjectName,
                 ds3_object ** Object)
+{
+	mdcache_info_t info;
+
+	GlobusGFSName(gds3_get_object);
+
+	*Object = NULL;
+
+	/* Cached objects carry no owner or storage class; no caller uses them. */
+	if (mdcache_lookup(Client, BucketName, ObjectName, &info) &&
+	    info.Type == MDCACHE_OBJECT)
+	{
+		*Object = malloc(sizeof(ds3_object));
+		if (!*Object)
+			return GlobusGFSErrorMemory("ds3_object");
+		memset(*Object, 0, sizeof(ds3_object));
+		(*Object)->name = ds3_str_init(ObjectName);
+		(*Object)->size = info.Size;
+		if (info.ETag[0])
+			(*Object)->etag = ds3_str_init(info.ETag);
+		if (info.LastModified[0])
+			(*Object)->last_modified = ds3_str_init(info.LastModified);
+		return GLOBUS_SUCCESS;
+	}
+
+	return gds3_get_object_uncached(Client, BucketName, ObjectName, Object);
+}
+
+/* Directories exist only as prefixes; one key under DirName/ is enough. */
+globus_result_t
+gds3_is_directory(ds3_client * Client,
+                  char       * BucketName,
+                  char       * DirName,
+                  int        * IsDirectory)
 {
 	ds3_get_bucket_response * response = NULL;
 	globus_result_t           result   = GLOBUS_SUCCESS;
-	char                    * marker   = NULL;
-	int                       i        = 0;
+	char                    * prefix   = NULL;
+	mdcache_info_t            info;
 
-	*Object = NULL;
+	GlobusGFSName(gds3_is_directory);
 
-	do {
-		result = gds3_get_bucket(Client,
-		                         BucketName,
-		                         &response,
-		                         "/",        // Delimiter
-		                         ObjectName, // Prefix
-		                         marker,
-		                         16);        // MaxKeys
+	*IsDirectory = 0;
 
-		if (!result)
-		{
-			for (i = 0; i < response->num_objects; i++)
-			{
-				if (strcmp(response->objects[i].name->value, ObjectName) == 0)
-				{
-					*Object = gds3_copy_object(&response->objects[i]);
-					break;
-				}
-			}
-		}
+	prefix = globus_common_create_string("%s/", DirName);
+	if (!prefix)
+		return GlobusGFSErrorMemory("prefix");
 
-		if (marker) free(marker);
-		marker = NULL;
-		if (response)
-		{
-			if (!*Object && response->next_marker)
-				marker = strdup(response->next_marker->value);
-			ds3_free_bucket_response(response);
-			response = NULL;
-		}
-	} while (!result && marker);
+	if (mdcache_lookup(Client, BucketName, prefix, &info) &&
+	    info.Type == MDCACHE_DIRECTORY)
+	{
+		globus_free(prefix);
+		*IsDirectory = 1;
+		return GLOBUS_SUCCESS;
+	}
 
+	result = gds3_get_bucket(Client,
+	                         BucketName,
+	                         &response,
+	                         NULL,   // Delimiter
+	                         prefix, // Prefix
+	                         NULL,   // Marker
+	                         1);     // MaxKeys
+	if (result)
+	{
+		globus_free(prefix);
+		return result;
+	}
+
+	*IsDirectory = (response->num_objects > 0 || response->num_common_prefixes > 0);
+
+	if (*IsDirectory)
+	{
+		memset(&info, 0, sizeof(info));
+		info.Type = MDCACHE_DIRECTORY;
+		mdcache_insert(Client, BucketName, prefix, &info);
+	}
+	globus_free(prefix);
+
+	ds3_free_bucket_response(response);
 	return GLOBUS_SUCCESS;
 }
 
@@ -221,6 +352,8 @@ gds3_init_bulk_put(ds3_client         * Client,
 	bulk_object.name      = ds3_str_init(ObjectName);
 	bulk_object.length    = Length;
 
+	mdcache_invalidate(Client, BucketName, ObjectName);
+
 	request = ds3_init_put_bulk(BucketName, &bulk_object_list);
 	error   = ds3_bulk(Client, request, BulkResponse);
 	result  = error_translate(error);
@@ -275,6 +408,51 @@ gds3_put_object_for_job(ds3_client * Client,
 	return result;
 }
 
+globus_result_t
+gds3_put_object(ds3_client * Client,
+                char       * BucketName,
+                char       * ObjectName,
+                uint64_t     Length,
+                size_t    (* BufferCallout)(void*, size_t, size_t, void*),
+                void       * BufferCalloutArg)
+{
+	globus_result_t   result  = GLOBUS_SUCCESS;
+	ds3_request     * request = NULL;
+	ds3_error       * error   = NULL;
+
+	mdcache_invalidate(Client, BucketName, ObjectName);
+
+	request = ds3_init_put_object(BucketName, ObjectName, Length);
+	error   = ds3_put_object(Client, request, BufferCalloutArg, BufferCallout);
+	result  = error_translate(error);
+	ds3_free_request(request);
+	ds3_free_error(error);
+	return result;
+}
+
+globus_result_t
+gds3_get_object_range(ds3_client * Client,
+                      char       * BucketName,
+                      char       * ObjectName,
+                      uint64_t     Offset,
+                      uint64_t     Length,
+                      size_t    (* BufferCallout)(void*, size_t, size_t, void*),
+                      void       * BufferCalloutArg)
+{
+	globus_result_t   result  = GLOBUS_SUCCESS;
+	ds3_request     * request = NULL;
+	ds3_error       * error   = NULL;
+
+	request = ds3_init_get_object(BucketName, ObjectName, Length);
+	if (Length)
+		ds3_request_set_byte_range(request, Offset, Offset + Length - 1);
+	error   = ds3_get_object(Client, request, BufferCalloutArg, BufferCallout);
+	result  = error_translate(error);
+	ds3_free_request(request);
+	ds3_free_error(error);
+	return result;
+}
+
 globus_result_t
 gds3_available_chunks(ds3_client                        *  Client,
                       ds3_str                           *  JobID,
@@ -300,6 +478,7 @@ gds3_init_bulk_get(ds3_client         * Client,
                    char               * ObjectName, 
                    uint64_t             Offset,
                    uint64_t             Length,
+                   ds3_chunk_ordering   Ordering,
                    ds3_bulk_response ** BulkResponse)
 {
 	ds3_bulk_object_list bulk_object_list;
@@ -317,7 +496,7 @@ gds3_init_bulk_get(ds3_client         * Client,
 	bulk_object.offset    = Offset;
 	bulk_object.length    = Length;
 
-	request = ds3_init_get_bulk(BucketName, &bulk_object_list, IN_ORDER);
+	request = ds3_init_get_bulk(BucketName, &bulk_object_list, Ordering);
 	error   = ds3_bulk(Client, request, BulkResponse);
 	result  = error_translate(error);
 	ds3_str_free(bulk_object.name);
@@ -331,6 +510,8 @@ gds3_get_object_for_job(ds3_client * Client,
                         char       * BucketName,
                         char       * ObjectName,
                         uint64_t     Offset,
+                        uint64_t     RangeOffset,
+                        uint64_t     Length,
                         char       * JobID,
                         size_t    (* BufferCallout)(void*, size_t, size_t, void*),
                         void       * BufferCalloutArg)
@@ -340,6 +521,8 @@ gds3_get_object_for_job(ds3_client * Client,
 	ds3_error       * error   = NULL;
 
 	request = ds3_init_get_object_for_job(BucketName, ObjectName, Offset, JobID);
+	if (Length)
+		ds3_request_set_byte_range(request, RangeOffset, RangeOffset + Length - 1);
 	error   = ds3_get_object(Client, request, BufferCalloutArg, BufferCallout);
 	result  = error_translate(error);
 	ds3_free_request(request);
@@ -348,7 +531,7 @@ gds3_get_object_for_job(ds3_client * Client,
 }
 
 globus_result_t
-gds3_delete_bucket(ds3_client * Client, char * BucketName)
+gds3_delete_bucket(ds3_client * Client, catalog_t * Catalog, char * BucketName)
 {
 	globus_result_t   result  = GLOBUS_SUCCESS;
 	ds3_request     * request = NULL;
@@ -357,6 +540,8 @@ gds3_delete_bucket(ds3_client * Client, char * BucketName)
 	request = ds3_init_delete_bucket(BucketName);
 	error   = ds3_delete_bucket(Client, request);
 	result  = error_translate(error);
+	catalog_invalidate(Catalog);
+	mdcache_flush();
 	ds3_free_request(request);
 	ds3_free_error(error);
 	return result;
@@ -374,6 +559,8 @@ gds3_delete_folder(ds3_client * Client,
 	request = ds3_init_delete_folder(BucketName, FolderName);
 	error   = ds3_delete_folder(Client, request);
 	result  = error_translate(error);
+	/* Every object under the folder is gone; we can not find them all. */
+	mdcache_flush();
 	ds3_free_request(request);
 	ds3_free_error(error);
 	return result;
@@ -391,6 +578,7 @@ gds3_delete_object(ds3_client * Client,
 	request = ds3_init_delete_object(BucketName, ObjectName);
 	error   = ds3_delete_object(Client, request);
 	result  = error_translate(error);
+	mdcache_invalidate(Client, BucketName, ObjectName);
 	ds3_free_request(request);
 	ds3_free_error(error);
 	return result;
@@ -52,6 +52,11 @@
  */
 #include <ds3.h>
 
+/*
+ * Local includes
+ */
+#include "catalog.h"
+
 globus_result_t
 gds3_get_service(ds3_client *, ds3_get_service_response **);
 
@@ -64,8 +69,24 @@ gds3_get_bucket(ds3_client              *  Client,
                 char                    *  Marker,
                 uint32_t                   MaxKeys);
 
+/*
+ * Same listing as gds3_get_bucket() but the raw ListBucketResult XML is
+ * passed to BufferCallout as it arrives instead of being parsed into a
+ * response. Return less than Size * Count from the callout to stop.
+ */
+globus_result_t
+gds3_stream_bucket(ds3_client * Client,
+                   char       * BucketName,
+                   char       * Delimiter,
+                   char       * Prefix,
+                   char       * Marker,
+                   uint32_t     MaxKeys,
+                   size_t    (* BufferCallout)(void*, size_t, size_t, void*),
+                   void       * BufferCalloutArg);
+
+/* Drops Catalog's bucket list whether or not the create worked. */
 globus_result_t
-gds3_put_bucket(ds3_client * Client, char * BucketName);
+gds3_put_bucket(ds3_client * Client, catalog_t * Catalog, char * BucketName);
 
 globus_result_t
 gds3_get_object(ds3_client *  Client, 
@@ -73,6 +94,19 @@ gds3_get_object(ds3_client *  Client,
                 char       *  ObjectName,
                 ds3_object ** Object);
 
+/* gds3_get_object() that always asks the BlackPearl. */
+globus_result_t
+gds3_get_object_uncached(ds3_client *  Client,
+                         char       *  BucketName,
+                         char       *  ObjectName,
+                         ds3_object ** Object);
+
+globus_result_t
+gds3_is_directory(ds3_client * Client,
+                  char       * BucketName,
+                  char       * DirName,
+                  int        * IsDirectory);
+
 ds3_object *
 gds3_copy_object(const ds3_object * SourceObject);
 
@@ -101,12 +135,34 @@ gds3_put_object_for_job(ds3_client * Client,
                         size_t    (* BufferCallout)(void*, size_t, size_t, void*),
                         void       * BufferCalloutArg);
 
+/*
+ * Puts or gets an object in a single request, without a bulk job. Meant for
+ * small objects, where the job round trips cost more than the data.
+ */
+globus_result_t
+gds3_put_object(ds3_client * Client,
+                char       * BucketName,
+                char       * ObjectName,
+                uint64_t     Length,
+                size_t    (* BufferCallout)(void*, size_t, size_t, void*),
+                void       * BufferCalloutArg);
+
+globus_result_t
+gds3_get_object_range(ds3_client * Client,
+                      char       * BucketName,
+                      char       * ObjectName,
+                      uint64_t     Offset,
+                      uint64_t     Length,
+                      size_t    (* BufferCallout)(void*, size_t, size_t, void*),
+                      void       * BufferCalloutArg);
+
 globus_result_t
 gds3_init_bulk_get(ds3_client        *  Client,
                    char              *  BucketName,
                    char              *  ObjectName,
                    uint64_t             Offset,
                    uint64_t             Length,
+                   ds3_chunk_ordering   Ordering,
                    ds3_bulk_response ** BulkResponse);
 
 globus_result_t
@@ -114,17 +170,24 @@ gds3_available_chunks(ds3_client                        *  Client,
                       ds3_str                           *  JobID,
                       ds3_get_available_chunks_response ** ChunkResponse);
 
+/*
+ * Offset is the start of the blob. If Length is non zero, only Length bytes
+ * starting at RangeOffset (an offset within the blob) are retrieved.
+ */
 globus_result_t
 gds3_get_object_for_job(ds3_client * Client,
                         char       * BucketName,
                         char       * ObjectName,
                         uint64_t     Offset,
+                        uint64_t     RangeOffset,
+                        uint64_t     Length,
                         char       * JobID,
                         size_t    (* BufferCallout)(void*, size_t, size_t, void*),
                         void       * BufferCalloutArg);
 
+/* Drops Catalog's bucket list whether or not the delete worked. */
 globus_result_t
-gds3_delete_bucket(ds3_client * Client, char * BucketName);
+gds3_delete_bucket(ds3_client * Client, catalog_t * Catalog, char * BucketName);
 
 globus_result_t
 gds3_delete_folder(ds3_client * Client, char * BucketName, char * FolderName);
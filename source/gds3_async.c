@@ -0,0 +1,199 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * System includes
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * DS3 includes
+ */
+#include <ds3.h>
+
+/*
+ * Local includes
+ */
+#include "gds3_async.h"
+#include "gds3.h"
+#include "workers.h"
+
+struct gds3_async {
+	ds3_client      * Client;
+	char            * BucketName;
+	char            * ObjectName;
+	globus_result_t   Result;
+	int               Started; // The worker or the waiter has it
+	int               Done;
+	int               Refs;    // The worker job and the handle
+};
+
+static pthread_mutex_t gds3_async_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  gds3_async_done  = PTHREAD_COND_INITIALIZER;
+
+static void
+gds3_async_free(gds3_async_t * Request)
+{
+	if (Request)
+	{
+		if (Request->BucketName) free(Request->BucketName);
+		if (Request->ObjectName) free(Request->ObjectName);
+		free(Request);
+	}
+}
+
+/* Called locked. Drops one reference; the last one frees the request. */
+static void
+gds3_async_release(gds3_async_t * Request)
+{
+	if (--Request->Refs == 0)
+		gds3_async_free(Request);
+}
+
+static void *
+gds3_async_thread(void * Arg)
+{
+	gds3_async_t * request = Arg;
+	int            run     = 0;
+
+	pthread_mutex_lock(&gds3_async_mutex);
+	{
+		/* The waiter may have got tired of waiting and run it already. */
+		run = !request->Started;
+		request->Started = 1;
+	}
+	pthread_mutex_unlock(&gds3_async_mutex);
+
+	if (run)
+		request->Result = gds3_delete_object(request->Client,
+		                                     request->BucketName,
+		                                     request->ObjectName);
+
+	pthread_mutex_lock(&gds3_async_mutex);
+	{
+		if (run)
+		{
+			request->Done = 1;
+			pthread_cond_broadcast(&gds3_async_done);
+		}
+		gds3_async_release(request);
+	}
+	pthread_mutex_unlock(&gds3_async_mutex);
+
+	return NULL;
+}
+
+globus_result_t
+gds3_async_delete_object(ds3_client    *  Client,
+                         char          *  BucketName,
+                         char          *  ObjectName,
+                         gds3_async_t  ** Handle)
+{
+	globus_result_t result  = GLOBUS_SUCCESS;
+	gds3_async_t  * request = NULL;
+
+	GlobusGFSName(gds3_async_delete_object);
+
+	*Handle = NULL;
+
+	request = calloc(1, sizeof(gds3_async_t));
+	if (!request)
+		return GlobusGFSErrorMemory("gds3_async_t");
+
+	request->Client     = Client;
+	request->BucketName = strdup(BucketName);
+	request->ObjectName = strdup(ObjectName);
+	request->Refs       = 2;
+	if (!request->BucketName || !request->ObjectName)
+	{
+		gds3_async_free(request);
+		return GlobusGFSErrorMemory("gds3_async_t");
+	}
+
+	result = workers_submit(WORKERS_COMMAND, gds3_async_thread, request);
+	if (result)
+	{
+		gds3_async_free(request);
+		return result;
+	}
+
+	*Handle = request;
+	return GLOBUS_SUCCESS;
+}
+
+globus_result_t
+gds3_async_wait(gds3_async_t * Handle)
+{
+	globus_result_t result = GLOBUS_SUCCESS;
+	int             run    = 0;
+
+	pthread_mutex_lock(&gds3_async_mutex);
+	{
+		/* Still queued; do not wait behind other work for a worker. */
+		run = !Handle->Started;
+		Handle->Started = 1;
+	}
+	pthread_mutex_unlock(&gds3_async_mutex);
+
+	if (run)
+		Handle->Result = gds3_delete_object(Handle->Client,
+		                                    Handle->BucketName,
+		                                    Handle->ObjectName);
+
+	pthread_mutex_lock(&gds3_async_mutex);
+	{
+		while (!run && !Handle->Done)
+			pthread_cond_wait(&gds3_async_done, &gds3_async_mutex);
+
+		result = Handle->Result;
+		gds3_async_release(Handle);
+	}
+	pthread_mutex_unlock(&gds3_async_mutex);
+
+	return result;
+}
@@ -0,0 +1,78 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * Background DS3 deletes. STOR starts removing the object it will replace,
+ * then waits for the delete only when it must. The delete runs as a command
+ * on the worker pool; if no worker has picked it up by the time we wait,
+ * the waiter runs it itself, so a full pool can not leave it stuck.
+ */
+
+#ifndef BLACKPEARL_DSI_GDS3_ASYNC_H
+#define BLACKPEARL_DSI_GDS3_ASYNC_H
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * DS3 includes
+ */
+#include <ds3.h>
+
+typedef struct gds3_async gds3_async_t;
+
+/* Names are copied. */
+globus_result_t
+gds3_async_delete_object(ds3_client    *  Client,
+                         char          *  BucketName,
+                         char          *  ObjectName,
+                         gds3_async_t  ** Handle);
+
+/*
+ * Waits for the delete to finish, frees Handle and returns the result of
+ * the DS3 call.
+ */
+globus_result_t
+gds3_async_wait(gds3_async_t * Handle);
+
+#endif /* BLACKPEARL_DSI_GDS3_ASYNC_H */
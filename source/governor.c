@@ -0,0 +1,403 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * System includes
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * Local includes
+ */
+#include "governor.h"
+
+#define GOVERNOR_MAGIC   0x474f5631 // GOV1
+#define GOVERNOR_VERSION 1
+#define GOVERNOR_SLOTS   1024       // Server processes sharing one table
+
+/*
+ * One per server process. Only the owner changes InUse and Transfers;
+ * everyone else just adds them up.
+ */
+typedef struct {
+	volatile int32_t  Pid;       // 0 = free, -1 = being reclaimed
+	uint32_t          Pad;
+	volatile uint64_t InUse;     // Bytes held by this process's transfers
+	volatile uint64_t Transfers; // Transfers joined in this process
+} governor_slot_t;
+
+typedef struct {
+	volatile uint32_t Magic;
+	uint32_t          Version;
+	uint32_t          SlotCnt;
+	uint32_t          Pad;
+	governor_slot_t   Slots[GOVERNOR_SLOTS];
+} governor_table_t;
+
+static pthread_mutex_t    governor_mutex = PTHREAD_MUTEX_INITIALIZER;
+static governor_stats_t   governor_stats;
+static governor_slot_t    governor_local;                  // Until we have a table
+static governor_slot_t  * governor_slot  = &governor_local;
+static governor_table_t * governor_table = NULL;
+
+/* Frees our slot on a clean exit; a crash leaves it for the next process. */
+static void
+governor_exit(void)
+{
+	governor_slot->InUse     = 0;
+	governor_slot->Transfers = 0;
+	__sync_synchronize();
+	governor_slot->Pid = 0;
+}
+
+/*
+ * Called locked. Frees the slots of processes that are gone and takes one
+ * for us. 0 = every slot is in use.
+ */
+static int
+governor_claim_slot(governor_table_t * Table)
+{
+	governor_slot_t * slot = NULL;
+	pid_t             self = getpid();
+	int32_t           pid  = 0;
+	int               i    = 0;
+
+	for (i = 0; i < GOVERNOR_SLOTS; i++)
+	{
+		slot = &Table->Slots[i];
+		pid  = slot->Pid;
+
+		/* A slot left by an earlier process with our pid is stale too. */
+		if (pid <= 0 || (pid != self && (kill(pid, 0) == 0 || errno != ESRCH)))
+			continue;
+
+		if (!__sync_bool_compare_and_swap(&slot->Pid, pid, -1))
+			continue;
+		slot->InUse     = 0;
+		slot->Transfers = 0;
+		__sync_synchronize();
+		slot->Pid = 0;
+	}
+
+	for (i = 0; i < GOVERNOR_SLOTS; i++)
+	{
+		slot = &Table->Slots[i];
+		if (!__sync_bool_compare_and_swap(&slot->Pid, 0, self))
+			continue;
+
+		/* Bring along what transfers in this process already hold. */
+		slot->InUse     = governor_local.InUse;
+		slot->Transfers = governor_local.Transfers;
+		governor_slot   = slot;
+		return 1;
+	}
+	return 0;
+}
+
+globus_result_t
+governor_init(const char * Path, const char * UserName)
+{
+	globus_result_t    result = GLOBUS_SUCCESS;
+	governor_table_t * table  = NULL;
+	struct stat        st;
+	char             * path   = NULL;
+	void             * map    = MAP_FAILED;
+	int                fd     = -1;
+
+	GlobusGFSName(governor_init);
+
+	if (!Path)
+		return GLOBUS_SUCCESS;
+
+	if (!UserName || !UserName[0] || strchr(UserName, '/'))
+		return GlobusGFSErrorGeneric("No usable user name for the buffer budget file");
+
+	pthread_mutex_lock(&governor_mutex);
+
+	if (governor_table)
+		goto cleanup;
+
+	path = globus_common_create_string("%s.%s", Path, UserName);
+	if (!path)
+	{
+		result = GlobusGFSErrorMemory("path");
+		goto cleanup;
+	}
+
+	fd = open(path, O_RDWR|O_CREAT|O_NOFOLLOW, 0600);
+	if (fd < 0)
+	{
+		result = GlobusGFSErrorSystemError("open()", errno);
+		goto cleanup;
+	}
+
+	if (fstat(fd, &st))
+	{
+		result = GlobusGFSErrorSystemError("fstat()", errno);
+		goto cleanup;
+	}
+
+	/* Anyone else who can write it can starve our transfers. */
+	if (st.st_uid != geteuid() || (st.st_mode & (S_IRWXG|S_IRWXO)))
+	{
+		result = GlobusGFSErrorGeneric("Buffer budget file is not private");
+		goto cleanup;
+	}
+
+	/* New files are all zeros, which is a table with every slot free. */
+	if (st.st_size == 0 && ftruncate(fd, sizeof(governor_table_t)))
+	{
+		result = GlobusGFSErrorSystemError("ftruncate()", errno);
+		goto cleanup;
+	} else if (st.st_size != 0 && st.st_size != sizeof(governor_table_t))
+	{
+		result = GlobusGFSErrorGeneric("Buffer budget file is not one of ours");
+		goto cleanup;
+	}
+
+	map = mmap(NULL, sizeof(governor_table_t), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+	{
+		result = GlobusGFSErrorSystemError("mmap()", errno);
+		goto cleanup;
+	}
+
+	table = map;
+	if (table->Magic == 0)
+	{
+		table->Version = GOVERNOR_VERSION;
+		table->SlotCnt = GOVERNOR_SLOTS;
+		__sync_bool_compare_and_swap(&table->Magic, 0, GOVERNOR_MAGIC);
+	}
+
+	if (table->Magic != GOVERNOR_MAGIC ||
+	    table->Version != GOVERNOR_VERSION ||
+	    table->SlotCnt != GOVERNOR_SLOTS)
+	{
+		result = GlobusGFSErrorGeneric("Buffer budget file is not one of ours");
+		goto cleanup;
+	}
+
+	if (!governor_claim_slot(table))
+	{
+		result = GlobusGFSErrorGeneric("Buffer budget file has no free slot");
+		goto cleanup;
+	}
+
+	atexit(governor_exit);
+	governor_table = table;
+	map = MAP_FAILED;
+
+cleanup:
+	pthread_mutex_unlock(&governor_mutex);
+	if (map != MAP_FAILED)
+		munmap(map, sizeof(governor_table_t));
+	if (fd >= 0)
+		close(fd);
+	if (path)
+		globus_free(path);
+	if (result)
+		result = GlobusGFSErrorWrapFailed("Opening buffer budget file", result);
+	return result;
+}
+
+void
+governor_set_budget(uint64_t Budget)
+{
+	pthread_mutex_lock(&governor_mutex);
+	governor_stats.Budget = Budget;
+	pthread_mutex_unlock(&governor_mutex);
+}
+
+/* Called locked. Sums every live process's slot, or just ours without a table. */
+static void
+governor_totals(uint64_t * InUse, uint64_t * Transfers)
+{
+	governor_slot_t * slot = NULL;
+	int               i    = 0;
+
+	if (!governor_table)
+	{
+		*InUse     = governor_slot->InUse;
+		*Transfers = governor_slot->Transfers;
+		return;
+	}
+
+	*InUse     = 0;
+	*Transfers = 0;
+	for (i = 0; i < GOVERNOR_SLOTS; i++)
+	{
+		slot = &governor_table->Slots[i];
+		if (slot->Pid <= 0)
+			continue;
+		*InUse     += slot->InUse;
+		*Transfers += slot->Transfers;
+	}
+}
+
+void
+governor_join(governor_share_t * Share)
+{
+	uint64_t in_use    = 0;
+	uint64_t transfers = 0;
+
+	pthread_mutex_lock(&governor_mutex);
+	{
+		Share->InUse = 0;
+		__sync_fetch_and_add(&governor_slot->Transfers, 1);
+
+		governor_totals(&in_use, &transfers);
+		if (transfers > governor_stats.HighWaterTransfers)
+			governor_stats.HighWaterTransfers = transfers;
+	}
+	pthread_mutex_unlock(&governor_mutex);
+}
+
+void
+governor_leave(governor_share_t * Share)
+{
+	pthread_mutex_lock(&governor_mutex);
+	{
+		__sync_fetch_and_sub(&governor_slot->InUse, Share->InUse);
+		__sync_fetch_and_sub(&governor_slot->Transfers, 1);
+		Share->InUse = 0;
+	}
+	pthread_mutex_unlock(&governor_mutex);
+}
+
+/* Called locked. */
+static uint64_t
+governor_fair_share(uint64_t Transfers)
+{
+	if (Transfers == 0)
+		return governor_stats.Budget;
+	return governor_stats.Budget / Transfers;
+}
+
+int
+governor_reserve(governor_share_t * Share, uint64_t Size, int Force)
+{
+	uint64_t in_use    = 0;
+	uint64_t transfers = 0;
+	int      granted   = 1;
+
+	pthread_mutex_lock(&governor_mutex);
+	{
+		governor_totals(&in_use, &transfers);
+
+		/*
+		 * Other processes may reserve at the same moment, so the budget can
+		 * be overrun by a buffer per process; it is a bound, not a quota.
+		 */
+		if (governor_stats.Budget && !Force)
+		{
+			if (in_use + Size > governor_stats.Budget ||
+			    Share->InUse + Size > governor_fair_share(transfers))
+				granted = 0;
+		}
+
+		if (granted)
+		{
+			Share->InUse += Size;
+			__sync_fetch_and_add(&governor_slot->InUse, Size);
+			if (in_use + Size > governor_stats.HighWater)
+				governor_stats.HighWater = in_use + Size;
+		} else
+			governor_stats.Delays++;
+	}
+	pthread_mutex_unlock(&governor_mutex);
+
+	return granted;
+}
+
+void
+governor_release(governor_share_t * Share, uint64_t Size)
+{
+	pthread_mutex_lock(&governor_mutex);
+	{
+		Share->InUse -= Size;
+		__sync_fetch_and_sub(&governor_slot->InUse, Size);
+	}
+	pthread_mutex_unlock(&governor_mutex);
+}
+
+int
+governor_over_share(governor_share_t * Share)
+{
+	uint64_t in_use    = 0;
+	uint64_t transfers = 0;
+	int      over      = 0;
+
+	pthread_mutex_lock(&governor_mutex);
+	if (governor_stats.Budget)
+	{
+		governor_totals(&in_use, &transfers);
+		over = Share->InUse > governor_fair_share(transfers);
+	}
+	pthread_mutex_unlock(&governor_mutex);
+
+	return over;
+}
+
+void
+governor_get_stats(governor_stats_t * Stats)
+{
+	pthread_mutex_lock(&governor_mutex);
+	{
+		*Stats = governor_stats;
+		governor_totals(&Stats->InUse, &Stats->Transfers);
+	}
+	pthread_mutex_unlock(&governor_mutex);
+}
@@ -0,0 +1,115 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * Budget for data buffers. Every STOR and RETR joins the governor for the
+ * life of the transfer and asks it before adding a buffer. Each transfer may
+ * hold up to an even share of the budget; past that, the transfer waits for
+ * its own buffers to come back instead of allocating more, which slows its
+ * register_read()/register_write() calls.
+ *
+ * Without a budget file the budget covers one server process. With one, it
+ * covers every process of the same user on this host: each process keeps
+ * its totals in its own slot of a shared table and adds up everyone's
+ * before granting a buffer. Slots of processes that died are reclaimed.
+ */
+
+#ifndef BLACKPEARL_DSI_GOVERNOR_H
+#define BLACKPEARL_DSI_GOVERNOR_H
+
+/*
+ * System includes
+ */
+#include <stdint.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+typedef struct {
+	uint64_t InUse; // Bytes of buffers held by this transfer
+} governor_share_t;
+
+typedef struct {
+	uint64_t Budget;             // 0 means unlimited
+	uint64_t InUse;              // Bytes held by all transfers sharing the budget
+	uint64_t HighWater;          // Most bytes this process saw held at once
+	uint64_t Transfers;          // Transfers sharing the budget
+	uint64_t HighWaterTransfers; // Most transfers this process saw at once
+	uint64_t Delays;             // Buffers refused because of the budget
+} governor_stats_t;
+
+/*
+ * Shares the budget through Path.UserName, created mode 0600. Once per
+ * process; later calls do nothing. On error, the budget stays per process.
+ */
+globus_result_t
+governor_init(const char * Path, const char * UserName);
+
+void
+governor_set_budget(uint64_t Budget);
+
+void
+governor_join(governor_share_t * Share);
+
+void
+governor_leave(governor_share_t * Share);
+
+/*
+ * 1 = Share may add a buffer of Size bytes, 0 = it should wait for one of
+ * its own buffers instead. Force grants the buffer regardless; transfers use
+ * it when they hold no buffer that could come back to them.
+ */
+int
+governor_reserve(governor_share_t * Share, uint64_t Size, int Force);
+
+void
+governor_release(governor_share_t * Share, uint64_t Size);
+
+/* 1 = Share holds more than its fair share and should give buffers back. */
+int
+governor_over_share(governor_share_t * Share);
+
+void
+governor_get_stats(governor_stats_t * Stats);
+
+#endif /* BLACKPEARL_DSI_GOVERNOR_H */
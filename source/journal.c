@@ -0,0 +1,390 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * System includes
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * DS3 includes
+ */
+#include <ds3.h>
+
+/*
+ * Local includes
+ */
+#include "journal.h"
+
+/*
+ * Journal files are named by a FNV-1a hash of the access ID, bucket, object
+ * and size, plus our uid. The names are stored in the journal so a
+ * collision looks like a miss.
+ */
+static char *
+journal_path(ds3_client * Client,
+             const char * JournalDir,
+             const char * Bucket,
+             const char * Object,
+             uint64_t     Size)
+{
+	const char * access_id = ds3_str_value(Client->creds->access_id);
+	uint64_t     hash      = 0xcbf29ce484222325ULL;
+	int          i         = 0;
+
+	for (i = 0; i <= strlen(access_id); i++)
+		hash = (hash ^ (unsigned char)access_id[i]) * 0x100000001b3ULL;
+	for (i = 0; i <= strlen(Bucket); i++)
+		hash = (hash ^ (unsigned char)Bucket[i]) * 0x100000001b3ULL;
+	for (i = 0; i <= strlen(Object); i++)
+		hash = (hash ^ (unsigned char)Object[i]) * 0x100000001b3ULL;
+	for (i = 0; i < sizeof(Size); i++)
+		hash = (hash ^ ((Size >> (i * 8)) & 0xff)) * 0x100000001b3ULL;
+
+	return globus_common_create_string("%s/%016llx.%u",
+	                                   JournalDir,
+	                                   (unsigned long long)hash,
+	                                   (unsigned)geteuid());
+}
+
+static size_t
+journal_length(uint64_t ChunkCnt, size_t BucketLength, size_t ObjectLength)
+{
+	return sizeof(journal_header_t) +
+	       ChunkCnt * sizeof(journal_chunk_t) +
+	       BucketLength +
+	       ObjectLength;
+}
+
+static globus_result_t
+journal_map(journal_t * Journal, int Fd, size_t Length)
+{
+	void * map = NULL;
+
+	GlobusGFSName(journal_map);
+
+	map = mmap(NULL, Length, PROT_READ|PROT_WRITE, MAP_SHARED, Fd, 0);
+	if (map == MAP_FAILED)
+		return GlobusGFSErrorSystemError("mmap()", errno);
+
+	Journal->MapLength = Length;
+	Journal->Header    = map;
+	Journal->Chunks    = (journal_chunk_t *)(Journal->Header + 1);
+	return GLOBUS_SUCCESS;
+}
+
+globus_result_t
+journal_open(ds3_client * Client,
+             const char * JournalDir,
+             const char * Bucket,
+             const char * Object,
+             uint64_t     Size,
+             journal_t ** Journal)
+{
+	globus_result_t    result  = GLOBUS_SUCCESS;
+	journal_t        * journal = NULL;
+	journal_header_t * header  = NULL;
+	char             * names   = NULL;
+	struct stat        st;
+	int                fd      = -1;
+
+	GlobusGFSName(journal_open);
+
+	*Journal = NULL;
+
+	journal = malloc(sizeof(journal_t));
+	if (!journal)
+		return GlobusGFSErrorMemory("journal_t");
+	memset(journal, 0, sizeof(journal_t));
+
+	journal->Path = journal_path(Client, JournalDir, Bucket, Object, Size);
+	if (!journal->Path)
+	{
+		result = GlobusGFSErrorMemory("journal path");
+		goto cleanup;
+	}
+
+	/* A symlink is not one of ours; treat it like any other stranger. */
+	fd = open(journal->Path, O_RDWR|O_NOFOLLOW);
+	if (fd < 0)
+	{
+		if (errno != ENOENT && errno != ELOOP)
+			result = GlobusGFSErrorWrapFailed("Opening restart journal",
+			                                  GlobusGFSErrorSystemError("open()", errno));
+		goto cleanup;
+	}
+
+	if (fstat(fd, &st))
+	{
+		result = GlobusGFSErrorWrapFailed("Opening restart journal",
+		                                  GlobusGFSErrorSystemError("fstat()", errno));
+		goto cleanup;
+	}
+
+	/*
+	 * JournalDir is shared, so anyone could have left this here. Trust only
+	 * journals that we wrote and no one else can change.
+	 */
+	if (st.st_uid != geteuid() || (st.st_mode & (S_IRWXG|S_IRWXO)))
+		goto cleanup;
+
+	/* Anything too short to hold a header is not one of ours. */
+	if (st.st_size < sizeof(journal_header_t))
+		goto cleanup;
+
+	result = journal_map(journal, fd, st.st_size);
+	if (result)
+		goto cleanup;
+
+	header = journal->Header;
+	if (header->Magic != JOURNAL_MAGIC || header->Version != JOURNAL_VERSION)
+		goto cleanup;
+
+	if (header->ChunkCnt > st.st_size / sizeof(journal_chunk_t) ||
+	    journal_length(header->ChunkCnt,
+	                   header->BucketLength,
+	                   header->ObjectLength) != st.st_size)
+		goto cleanup;
+
+	names = (char *)(journal->Chunks + header->ChunkCnt);
+	if (header->Size != Size                                ||
+	    header->BucketLength != strlen(Bucket)              ||
+	    header->ObjectLength != strlen(Object)              ||
+	    memcmp(names, Bucket, header->BucketLength) != 0    ||
+	    memcmp(names + header->BucketLength, Object, header->ObjectLength) != 0)
+		goto cleanup;
+
+	header->JobID[sizeof(header->JobID) - 1] = '\0';
+	*Journal = journal;
+
+cleanup:
+	if (fd >= 0)
+		close(fd);
+
+	if (!*Journal)
+		journal_close(journal);
+	return result;
+}
+
+globus_result_t
+journal_create(ds3_client        * Client,
+               const char        * JournalDir,
+               const char        * Bucket,
+               const char        * Object,
+               uint64_t            Size,
+               ds3_bulk_response * BulkResponse,
+               journal_t        ** Journal)
+{
+	globus_result_t    result   = GLOBUS_SUCCESS;
+	journal_t        * journal  = NULL;
+	journal_header_t * header   = NULL;
+	char             * names    = NULL;
+	char             * tmp_path = NULL;
+	size_t             length   = 0;
+	int                fd       = -1;
+	int                i        = 0;
+
+	GlobusGFSName(journal_create);
+
+	*Journal = NULL;
+
+	if (BulkResponse->job_id->size >= sizeof(header->JobID))
+		return GlobusGFSErrorGeneric("Job ID is too long for the restart journal");
+
+	journal = malloc(sizeof(journal_t));
+	if (!journal)
+		return GlobusGFSErrorMemory("journal_t");
+	memset(journal, 0, sizeof(journal_t));
+
+	journal->Path = journal_path(Client, JournalDir, Bucket, Object, Size);
+	if (journal->Path)
+		tmp_path = globus_common_create_string("%s.%d", journal->Path, getpid());
+	if (!tmp_path)
+	{
+		result = GlobusGFSErrorMemory("journal path");
+		goto cleanup;
+	}
+
+	/*
+	 * Build the journal under a temporary name and rename it into place so
+	 * a reader never sees a partial journal. O_EXCL so we never write
+	 * through a file or symlink someone else left under that name.
+	 */
+	fd = open(tmp_path, O_RDWR|O_CREAT|O_EXCL|O_NOFOLLOW, S_IRUSR|S_IWUSR);
+	if (fd < 0)
+	{
+		result = GlobusGFSErrorWrapFailed("Creating restart journal",
+		                                  GlobusGFSErrorSystemError("open()", errno));
+		goto cleanup;
+	}
+
+	length = journal_length(BulkResponse->list_size, strlen(Bucket), strlen(Object));
+	if (ftruncate(fd, length))
+	{
+		result = GlobusGFSErrorWrapFailed("Creating restart journal",
+		                                  GlobusGFSErrorSystemError("ftruncate()", errno));
+		goto cleanup;
+	}
+
+	result = journal_map(journal, fd, length);
+	if (result)
+		goto cleanup;
+
+	header = journal->Header;
+	header->Magic        = JOURNAL_MAGIC;
+	header->Version      = JOURNAL_VERSION;
+	header->Size         = Size;
+	header->ChunkCnt     = BulkResponse->list_size;
+	header->BucketLength = strlen(Bucket);
+	header->ObjectLength = strlen(Object);
+	memcpy(header->JobID, BulkResponse->job_id->value, BulkResponse->job_id->size);
+
+	// Each chunk has one object
+	for (i = 0; i < BulkResponse->list_size; i++)
+	{
+		journal->Chunks[i].Offset    = BulkResponse->list[i]->list[0].offset;
+		journal->Chunks[i].Length    = BulkResponse->list[i]->list[0].length;
+		journal->Chunks[i].Completed = 0;
+	}
+
+	names = (char *)(journal->Chunks + header->ChunkCnt);
+	memcpy(names, Bucket, header->BucketLength);
+	memcpy(names + header->BucketLength, Object, header->ObjectLength);
+
+	if (rename(tmp_path, journal->Path))
+	{
+		result = GlobusGFSErrorWrapFailed("Creating restart journal",
+		                                  GlobusGFSErrorSystemError("rename()", errno));
+		goto cleanup;
+	}
+
+	*Journal = journal;
+
+cleanup:
+	if (fd >= 0)
+		close(fd);
+
+	if (result)
+	{
+		if (tmp_path) unlink(tmp_path);
+		journal_close(journal);
+	}
+	if (tmp_path) free(tmp_path);
+	return result;
+}
+
+const char *
+journal_job_id(journal_t * Journal)
+{
+	return Journal->Header->JobID;
+}
+
+static journal_chunk_t *
+journal_find_chunk(journal_t * Journal, uint64_t Offset)
+{
+	int i = 0;
+
+	for (i = 0; i < Journal->Header->ChunkCnt; i++)
+	{
+		if (Journal->Chunks[i].Offset == Offset)
+			return &Journal->Chunks[i];
+	}
+	return NULL;
+}
+
+int
+journal_has_chunk(journal_t * Journal, uint64_t Offset)
+{
+	return journal_find_chunk(Journal, Offset) != NULL;
+}
+
+int
+journal_chunk_completed(journal_t * Journal, uint64_t Offset)
+{
+	journal_chunk_t * chunk = journal_find_chunk(Journal, Offset);
+
+	return chunk && chunk->Completed;
+}
+
+void
+journal_complete_chunk(journal_t * Journal, uint64_t Offset)
+{
+	journal_chunk_t * chunk = journal_find_chunk(Journal, Offset);
+
+	if (chunk)
+		chunk->Completed = 1;
+}
+
+void
+journal_remove(journal_t * Journal)
+{
+	if (Journal)
+	{
+		unlink(Journal->Path);
+		journal_close(Journal);
+	}
+}
+
+void
+journal_close(journal_t * Journal)
+{
+	if (Journal)
+	{
+		if (Journal->Header)
+			munmap(Journal->Header, Journal->MapLength);
+		if (Journal->Path)
+			free(Journal->Path);
+		free(Journal);
+	}
+}
@@ -0,0 +1,137 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+#ifndef BLACKPEARL_DSI_JOURNAL_H
+#define BLACKPEARL_DSI_JOURNAL_H
+
+/*
+ * System includes
+ */
+#include <stdint.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * DS3 includes
+ */
+#include <ds3.h>
+
+/*
+ * The restart journal remembers which bulk put job is uploading an object and
+ * which of its chunks are complete, so a restarted STOR does not need to scan
+ * every job on the BlackPearl. There is one small file per access ID, bucket,
+ * object, size and uid under JournalDir, mode 0600, mapped shared so chunk
+ * completions persist as they happen. Journals owned by anyone else, or that
+ * others can write, are ignored.
+ */
+
+#define JOURNAL_MAGIC   0x4a535042 /* "BPSJ" */
+#define JOURNAL_VERSION 1
+
+typedef struct {
+	uint32_t Magic;
+	uint32_t Version;
+	uint64_t Size;
+	uint64_t ChunkCnt;
+	uint32_t BucketLength;
+	uint32_t ObjectLength;
+	char     JobID[64];
+	/* Followed by ChunkCnt journal_chunk_t, the bucket and the object. */
+} journal_header_t;
+
+typedef struct {
+	uint64_t Offset;
+	uint64_t Length;
+	uint64_t Completed;
+} journal_chunk_t;
+
+typedef struct {
+	char             * Path;
+	size_t             MapLength;
+	journal_header_t * Header;
+	journal_chunk_t  * Chunks;
+} journal_t;
+
+/*
+ * Sets *Journal to NULL if there is no journal for this object.
+ */
+globus_result_t
+journal_open(ds3_client * Client,
+             const char * JournalDir,
+             const char * Bucket,
+             const char * Object,
+             uint64_t     Size,
+             journal_t ** Journal);
+
+globus_result_t
+journal_create(ds3_client        * Client,
+               const char        * JournalDir,
+               const char        * Bucket,
+               const char        * Object,
+               uint64_t            Size,
+               ds3_bulk_response * BulkResponse,
+               journal_t        ** Journal);
+
+const char *
+journal_job_id(journal_t * Journal);
+
+/* 1 = Offset starts a chunk of the journaled job, 0 = it does not. */
+int
+journal_has_chunk(journal_t * Journal, uint64_t Offset);
+
+/* 1 = the chunk at Offset is complete, 0 = it is not. */
+int
+journal_chunk_completed(journal_t * Journal, uint64_t Offset);
+
+void
+journal_complete_chunk(journal_t * Journal, uint64_t Offset);
+
+/* Removes the journal file and closes the journal. */
+void
+journal_remove(journal_t * Journal);
+
+void
+journal_close(journal_t * Journal);
+
+#endif /* BLACKPEARL_DSI_JOURNAL_H */
@@ -0,0 +1,344 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * System includes
+ */
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Local includes
+ */
+#include "listing.h"
+
+void
+listing_parser_init(listing_parser_t * Parser,
+                    listing_callback   Callback,
+                    void             * CallbackArg)
+{
+	memset(Parser, 0, sizeof(listing_parser_t));
+	Parser->Callback    = Callback;
+	Parser->CallbackArg = CallbackArg;
+}
+
+/* Appends one code point as UTF-8. 0 = no room. */
+static int
+listing_put_utf8(char * Dst, size_t DstSize, size_t * Used, unsigned long Code)
+{
+	char   buf[4];
+	size_t length = 0;
+
+	if (Code < 0x80)
+	{
+		buf[length++] = Code;
+	} else if (Code < 0x800)
+	{
+		buf[length++] = 0xC0 | (Code >> 6);
+		buf[length++] = 0x80 | (Code & 0x3F);
+	} else if (Code < 0x10000)
+	{
+		buf[length++] = 0xE0 | (Code >> 12);
+		buf[length++] = 0x80 | ((Code >> 6) & 0x3F);
+		buf[length++] = 0x80 | (Code & 0x3F);
+	} else
+	{
+		buf[length++] = 0xF0 | (Code >> 18);
+		buf[length++] = 0x80 | ((Code >> 12) & 0x3F);
+		buf[length++] = 0x80 | ((Code >> 6) & 0x3F);
+		buf[length++] = 0x80 | (Code & 0x3F);
+	}
+
+	if (*Used + length >= DstSize)
+		return 0;
+	memcpy(Dst + *Used, buf, length);
+	*Used += length;
+	return 1;
+}
+
+/* Copies the element text into Dst, undoing XML escapes. 0 = no room or a bad escape. */
+static int
+listing_copy_text(listing_parser_t * Parser, char * Dst, size_t DstSize)
+{
+	const char  * src    = Parser->Text;
+	const char  * end    = Parser->Text + Parser->TextLength;
+	const char  * semi   = NULL;
+	char        * stop   = NULL;
+	unsigned long code   = 0;
+	size_t        used   = 0;
+
+	while (src < end)
+	{
+		if (*src != '&')
+		{
+			if (used + 1 >= DstSize)
+				return 0;
+			Dst[used++] = *src++;
+			continue;
+		}
+
+		semi = memchr(src, ';', end - src);
+		if (!semi)
+			return 0;
+
+		stop = NULL;
+
+		if (strncmp(src, "&lt;", 4) == 0)
+			code = '<';
+		else if (strncmp(src, "&gt;", 4) == 0)
+			code = '>';
+		else if (strncmp(src, "&amp;", 5) == 0)
+			code = '&';
+		else if (strncmp(src, "&quot;", 6) == 0)
+			code = '"';
+		else if (strncmp(src, "&apos;", 6) == 0)
+			code = '\'';
+		else if (src[1] == '#' && (src[2] == 'x' || src[2] == 'X') && isxdigit((unsigned char)src[3]))
+			code = strtoul(src + 3, &stop, 16);
+		else if (src[1] == '#' && isdigit((unsigned char)src[2]))
+			code = strtoul(src + 2, &stop, 10);
+		else
+			return 0;
+
+		/* Numeric references must fill the escape and name a Unicode scalar value. */
+		if (stop && stop != semi)
+			return 0;
+		if (code == 0 || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF))
+			return 0;
+		if (!listing_put_utf8(Dst, DstSize, &used, code))
+			return 0;
+		src = semi + 1;
+	}
+
+	Dst[used] = '\0';
+	return 1;
+}
+
+/* The most recent key or prefix, which is where the next page starts. */
+static void
+listing_note_key(listing_parser_t * Parser)
+{
+	if (strcmp(Parser->Entry.Key, Parser->LastKey) > 0)
+		strcpy(Parser->LastKey, Parser->Entry.Key);
+}
+
+static int
+listing_end_element(listing_parser_t * Parser, const char * Name)
+{
+	listing_entry_t * entry = &Parser->Entry;
+
+	if (Parser->InContents)
+	{
+		if (strcmp(Name, "Key") == 0)
+			return listing_copy_text(Parser, entry->Key, sizeof(entry->Key));
+		if (strcmp(Name, "Size") == 0)
+		{
+			Parser->Text[Parser->TextLength] = '\0';
+			entry->Size = strtoull(Parser->Text, NULL, 10);
+			return 1;
+		}
+		if (strcmp(Name, "LastModified") == 0)
+			return listing_copy_text(Parser, entry->LastModified, sizeof(entry->LastModified));
+		if (Parser->InOwner && strcmp(Name, "DisplayName") == 0)
+			return listing_copy_text(Parser, entry->Owner, sizeof(entry->Owner));
+		if (strcmp(Name, "Owner") == 0)
+		{
+			Parser->InOwner = 0;
+			return 1;
+		}
+		if (strcmp(Name, "Contents") == 0)
+		{
+			Parser->InContents = 0;
+			listing_note_key(Parser);
+			return Parser->Callback(entry, Parser->CallbackArg) == 0;
+		}
+		return 1;
+	}
+
+	if (Parser->InPrefixes)
+	{
+		if (strcmp(Name, "Prefix") == 0)
+			return listing_copy_text(Parser, entry->Key, sizeof(entry->Key));
+		if (strcmp(Name, "CommonPrefixes") == 0)
+		{
+			Parser->InPrefixes = 0;
+			listing_note_key(Parser);
+			return Parser->Callback(entry, Parser->CallbackArg) == 0;
+		}
+		return 1;
+	}
+
+	if (strcmp(Name, "IsTruncated") == 0)
+	{
+		Parser->IsTruncated = (Parser->TextLength == 4 && strncmp(Parser->Text, "true", 4) == 0);
+		return 1;
+	}
+	if (strcmp(Name, "NextMarker") == 0)
+		return listing_copy_text(Parser, Parser->NextMarker, sizeof(Parser->NextMarker));
+	return 1;
+}
+
+static void
+listing_start_element(listing_parser_t * Parser, const char * Name)
+{
+	if (strcmp(Name, "Contents") == 0)
+	{
+		memset(&Parser->Entry, 0, sizeof(listing_entry_t));
+		Parser->InContents = 1;
+	} else if (strcmp(Name, "CommonPrefixes") == 0)
+	{
+		memset(&Parser->Entry, 0, sizeof(listing_entry_t));
+		Parser->Entry.IsPrefix = 1;
+		Parser->InPrefixes     = 1;
+	} else if (Parser->InContents && strcmp(Name, "Owner") == 0)
+	{
+		Parser->InOwner = 1;
+	}
+}
+
+/*
+ * Handles the tag in Parser->Tag. Parser->Text holds what came between it
+ * and the tag before, which for the elements we keep is their value.
+ * 0 = stop.
+ */
+static int
+listing_tag(listing_parser_t * Parser)
+{
+	char * name    = Parser->Tag;
+	int    closing = 0;
+	int    empty   = 0;
+	int    rc      = 1;
+
+	Parser->Tag[Parser->TagLength] = '\0';
+
+	/* Declarations, processing instructions and comments. */
+	if (name[0] == '?' || name[0] == '!')
+		goto cleanup;
+
+	if (name[0] == '/')
+	{
+		closing = 1;
+		name++;
+	}
+	if (Parser->TagLength && Parser->Tag[Parser->TagLength - 1] == '/')
+		empty = 1;
+
+	name[strcspn(name, " \t\r\n/")] = '\0';
+
+	if (!closing)
+		listing_start_element(Parser, name);
+	if (closing || empty)
+		rc = listing_end_element(Parser, name);
+
+cleanup:
+	Parser->TextLength = 0;
+	Parser->TagLength  = 0;
+	return rc;
+}
+
+int
+listing_parser_feed(listing_parser_t * Parser, const char * Bytes, size_t Length)
+{
+	const char * mark   = NULL;
+	size_t       length = 0;
+	size_t       copy   = 0;
+
+	if (Parser->Failed)
+		return -1;
+
+	/*
+	 * memchr() is libc's vectorized scan, so text and tags are crossed many
+	 * bytes at a time on the way to the next delimiter.
+	 */
+	while (Length)
+	{
+		mark   = memchr(Bytes, Parser->InTag ? '>' : '<', Length);
+		length = mark ? mark - Bytes : Length;
+
+		if (Parser->InTag)
+		{
+			/* Only the name matters; a tag this long is not one of ours. */
+			copy = length;
+			if (Parser->TagLength + copy >= LISTING_TAG_MAX)
+				copy = LISTING_TAG_MAX - 1 - Parser->TagLength;
+			memcpy(Parser->Tag + Parser->TagLength, Bytes, copy);
+			Parser->TagLength += copy;
+		} else
+		{
+			/* No value we keep is this long escaped. */
+			if (Parser->TextLength + length >= LISTING_TEXT_MAX)
+			{
+				Parser->Failed = 1;
+				return -1;
+			}
+			memcpy(Parser->Text + Parser->TextLength, Bytes, length);
+			Parser->TextLength += length;
+		}
+
+		if (!mark)
+			break;
+
+		if (Parser->InTag && !listing_tag(Parser))
+		{
+			Parser->Failed = 1;
+			return -1;
+		}
+
+		Parser->InTag = !Parser->InTag;
+		Bytes  += length + 1;
+		Length -= length + 1;
+	}
+
+	return 0;
+}
+
+const char *
+listing_parser_next_marker(listing_parser_t * Parser)
+{
+	if (!Parser->IsTruncated)
+		return NULL;
+	if (Parser->NextMarker[0])
+		return Parser->NextMarker;
+	if (Parser->LastKey[0])
+		return Parser->LastKey;
+	return NULL;
+}
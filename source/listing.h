@@ -0,0 +1,108 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * Incremental parser for DS3 ListBucketResult documents. Bytes are fed in
+ * as they arrive and each Contents or CommonPrefixes entry is handed to the
+ * callback as soon as its closing tag is seen, so memory stays the same
+ * however many keys a page holds. Only the elements stat needs are kept.
+ */
+
+#ifndef BLACKPEARL_DSI_LISTING_H
+#define BLACKPEARL_DSI_LISTING_H
+
+/*
+ * System includes
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+/* S3 keys are at most 1024 bytes of UTF-8. */
+#define LISTING_KEY_MAX  1025
+#define LISTING_TEXT_MAX (LISTING_KEY_MAX * 6) // Room for escaped text
+#define LISTING_TAG_MAX  64                    // Longer tags are not ours
+
+typedef struct {
+	int      IsPrefix;                // A CommonPrefixes entry
+	char     Key[LISTING_KEY_MAX];
+	uint64_t Size;
+	char     LastModified[64];        // "" if none
+	char     Owner[256];              // "" if none
+} listing_entry_t;
+
+/* Nonzero stops the parse. */
+typedef int (*listing_callback)(listing_entry_t * Entry, void * CallbackArg);
+
+typedef struct {
+	listing_callback Callback;
+	void           * CallbackArg;
+
+	int              InTag;
+	char             Tag[LISTING_TAG_MAX];
+	size_t           TagLength;
+	char             Text[LISTING_TEXT_MAX];
+	size_t           TextLength;
+
+	int              InContents;
+	int              InPrefixes;
+	int              InOwner;
+	listing_entry_t  Entry;
+
+	int              IsTruncated;
+	char             NextMarker[LISTING_KEY_MAX];
+	char             LastKey[LISTING_KEY_MAX];
+	int              Failed;
+} listing_parser_t;
+
+void
+listing_parser_init(listing_parser_t * Parser,
+                    listing_callback   Callback,
+                    void             * CallbackArg);
+
+/* 0 = keep going; -1 = malformed input or the callback stopped us. */
+int
+listing_parser_feed(listing_parser_t * Parser, const char * Bytes, size_t Length);
+
+/* Where the next page starts; NULL if this was the last page. */
+const char *
+listing_parser_next_marker(listing_parser_t * Parser);
+
+#endif /* BLACKPEARL_DSI_LISTING_H */
@@ -0,0 +1,486 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * System includes
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * DS3 includes
+ */
+#include <ds3.h>
+
+/*
+ * Local includes
+ */
+#include "mdcache.h"
+
+#define MDCACHE_MAGIC      0x4d444331 // MDC1
+#define MDCACHE_VERSION    1
+#define MDCACHE_READ_TRIES 4
+
+typedef struct {
+	volatile uint32_t Magic;
+	uint32_t          Version;
+	uint32_t          EntryCnt;
+	uint32_t          EntrySize;
+	volatile uint64_t Epoch;
+	mdcache_stats_t   Stats;
+} mdcache_header_t;
+
+typedef struct {
+	volatile uint32_t Seq; // Odd while a writer holds the entry
+	uint32_t          Type;
+	uint64_t          Hash;
+	uint64_t          Epoch;
+	int64_t           Expires;
+	uint64_t          Size;
+	char              ETag[MDCACHE_ETAG_MAX];
+	char              LastModified[MDCACHE_TIME_MAX];
+	char              Key[MDCACHE_KEY_MAX];
+} mdcache_entry_t;
+
+static pthread_mutex_t    mdcache_mutex   = PTHREAD_MUTEX_INITIALIZER;
+static mdcache_header_t * mdcache_header  = NULL;
+static mdcache_entry_t  * mdcache_entries = NULL;
+static int                mdcache_ttl     = 0;
+
+#define MDCACHE_COUNT(Counter) __sync_fetch_and_add(&mdcache_header->Stats.Counter, 1)
+
+globus_result_t
+mdcache_init(const char * Path, const char * UserName, int TTL)
+{
+	globus_result_t    result = GLOBUS_SUCCESS;
+	mdcache_header_t * header = NULL;
+	size_t             length = 0;
+	struct stat        st;
+	char             * path   = NULL;
+	void             * map    = MAP_FAILED;
+	int                fd     = -1;
+
+	GlobusGFSName(mdcache_init);
+
+	if (!Path)
+		return GLOBUS_SUCCESS;
+
+	if (!UserName || !UserName[0] || strchr(UserName, '/'))
+		return GlobusGFSErrorGeneric("No usable user name for the metadata cache file");
+
+	length = sizeof(mdcache_header_t) + MDCACHE_ENTRIES * sizeof(mdcache_entry_t);
+
+	pthread_mutex_lock(&mdcache_mutex);
+
+	if (mdcache_header)
+		goto cleanup;
+
+	path = globus_common_create_string("%s.%s", Path, UserName);
+	if (!path)
+	{
+		result = GlobusGFSErrorMemory("path");
+		goto cleanup;
+	}
+
+	fd = open(path, O_RDWR|O_CREAT|O_NOFOLLOW, 0600);
+	if (fd < 0)
+	{
+		result = GlobusGFSErrorSystemError("open()", errno);
+		goto cleanup;
+	}
+
+	if (fstat(fd, &st))
+	{
+		result = GlobusGFSErrorSystemError("fstat()", errno);
+		goto cleanup;
+	}
+
+	/* Anyone else who can write it can plant entries. */
+	if (st.st_uid != geteuid() || (st.st_mode & (S_IRWXG|S_IRWXO)))
+	{
+		result = GlobusGFSErrorGeneric("Metadata cache file is not private");
+		goto cleanup;
+	}
+
+	/* New files are all zeros, which is an empty table. */
+	if (st.st_size == 0 && ftruncate(fd, length))
+	{
+		result = GlobusGFSErrorSystemError("ftruncate()", errno);
+		goto cleanup;
+	} else if (st.st_size != 0 && st.st_size != length)
+	{
+		result = GlobusGFSErrorGeneric("Metadata cache file is not one of ours");
+		goto cleanup;
+	}
+
+	map = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+	{
+		result = GlobusGFSErrorSystemError("mmap()", errno);
+		goto cleanup;
+	}
+
+	/* The first process in stamps the header; the values are constants. */
+	header = map;
+	if (header->Magic == 0)
+	{
+		header->Version   = MDCACHE_VERSION;
+		header->EntryCnt  = MDCACHE_ENTRIES;
+		header->EntrySize = sizeof(mdcache_entry_t);
+		__sync_bool_compare_and_swap(&header->Magic, 0, MDCACHE_MAGIC);
+	}
+
+	if (header->Magic     != MDCACHE_MAGIC   ||
+	    header->Version   != MDCACHE_VERSION ||
+	    header->EntryCnt  != MDCACHE_ENTRIES ||
+	    header->EntrySize != sizeof(mdcache_entry_t))
+	{
+		result = GlobusGFSErrorGeneric("Metadata cache file is not one of ours");
+		goto cleanup;
+	}
+
+	mdcache_header  = header;
+	mdcache_entries = (mdcache_entry_t *)(header + 1);
+	mdcache_ttl     = TTL;
+	map             = MAP_FAILED;
+
+cleanup:
+	pthread_mutex_unlock(&mdcache_mutex);
+	if (map != MAP_FAILED)
+		munmap(map, length);
+	if (fd >= 0)
+		close(fd);
+	if (path)
+		globus_free(path);
+	if (result)
+		result = GlobusGFSErrorWrapFailed("Opening metadata cache", result);
+	return result;
+}
+
+/* Builds the key and its FNV-1a hash. 0 = the key is too long to cache. */
+static int
+mdcache_key(ds3_client * Client,
+            const char * Bucket,
+            const char * Name,
+            char       * Key,
+            uint64_t   * Hash)
+{
+	int length = 0;
+	int i      = 0;
+
+	length = snprintf(Key,
+	                  MDCACHE_KEY_MAX,
+	                  "%s\n%s\n%s",
+	                  ds3_str_value(Client->creds->access_id),
+	                  Bucket,
+	                  Name);
+	if (length < 0 || length >= MDCACHE_KEY_MAX)
+		return 0;
+
+	*Hash = 0xcbf29ce484222325ULL;
+	for (i = 0; i < length; i++)
+		*Hash = (*Hash ^ (unsigned char)Key[i]) * 0x100000001b3ULL;
+
+	/* 0 marks an empty entry. */
+	if (*Hash == 0)
+		*Hash = 1;
+	return 1;
+}
+
+static mdcache_entry_t *
+mdcache_slot(uint64_t Hash, int Probe)
+{
+	return &mdcache_entries[(Hash + Probe) % MDCACHE_ENTRIES];
+}
+
+/* 1 = Copy holds a consistent snapshot of Entry. */
+static int
+mdcache_read(mdcache_entry_t * Entry, mdcache_entry_t * Copy)
+{
+	uint32_t seq   = 0;
+	int      tries = 0;
+
+	for (tries = 0; tries < MDCACHE_READ_TRIES; tries++)
+	{
+		seq = Entry->Seq;
+		__sync_synchronize();
+		if (seq & 1)
+			continue;
+
+		memcpy(Copy, (void *)Entry, sizeof(mdcache_entry_t));
+		__sync_synchronize();
+
+		if (Entry->Seq == seq)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * 1 = we hold Entry. Writers never wait; if another process holds the
+ * entry, we skip the update.
+ */
+static int
+mdcache_lock(mdcache_entry_t * Entry)
+{
+	uint32_t seq = Entry->Seq;
+
+	if (seq & 1)
+		return 0;
+	return __sync_bool_compare_and_swap(&Entry->Seq, seq, seq + 1);
+}
+
+static void
+mdcache_unlock(mdcache_entry_t * Entry)
+{
+	__sync_synchronize();
+	__sync_fetch_and_add(&Entry->Seq, 1);
+}
+
+/* 1 = Entry is a live copy of Key in the current epoch. */
+static int
+mdcache_matches(mdcache_entry_t * Entry, const char * Key, uint64_t Hash)
+{
+	return (Entry->Hash  == Hash &&
+	        Entry->Epoch == mdcache_header->Epoch &&
+	        strncmp(Entry->Key, Key, MDCACHE_KEY_MAX) == 0);
+}
+
+int
+mdcache_lookup(ds3_client     * Client,
+               const char     * Bucket,
+               const char     * Name,
+               mdcache_info_t * Info)
+{
+	mdcache_entry_t copy;
+	char            key[MDCACHE_KEY_MAX];
+	uint64_t        hash  = 0;
+	int             probe = 0;
+
+	if (!mdcache_header || !mdcache_key(Client, Bucket, Name, key, &hash))
+		return 0;
+
+	for (probe = 0; probe < MDCACHE_PROBES; probe++)
+	{
+		/* Check the hash before copying the whole entry. */
+		if (mdcache_slot(hash, probe)->Hash != hash)
+			continue;
+
+		if (!mdcache_read(mdcache_slot(hash, probe), &copy) ||
+		    !mdcache_matches(&copy, key, hash))
+			continue;
+
+		if (copy.Expires < time(NULL))
+		{
+			MDCACHE_COUNT(Stale);
+			break;
+		}
+
+		Info->Type = copy.Type;
+		Info->Size = copy.Size;
+		memcpy(Info->ETag, copy.ETag, MDCACHE_ETAG_MAX);
+		memcpy(Info->LastModified, copy.LastModified, MDCACHE_TIME_MAX);
+		Info->ETag[MDCACHE_ETAG_MAX - 1]         = '\0';
+		Info->LastModified[MDCACHE_TIME_MAX - 1] = '\0';
+
+		MDCACHE_COUNT(Hits);
+		return 1;
+	}
+
+	MDCACHE_COUNT(Misses);
+	return 0;
+}
+
+void
+mdcache_insert(ds3_client     * Client,
+               const char     * Bucket,
+               const char     * Name,
+               mdcache_info_t * Info)
+{
+	mdcache_entry_t * entry  = NULL;
+	mdcache_entry_t * victim = NULL;
+	char              key[MDCACHE_KEY_MAX];
+	uint64_t          hash   = 0;
+	time_t            now    = time(NULL);
+	int               probe  = 0;
+
+	if (!mdcache_header || !mdcache_key(Client, Bucket, Name, key, &hash))
+		return;
+
+	/*
+	 * Reuse our own entry, else an empty, expired or flushed one, else the
+	 * one closest to expiring. Racing readers are caught by the sequence.
+	 */
+	for (probe = 0; probe < MDCACHE_PROBES; probe++)
+	{
+		entry = mdcache_slot(hash, probe);
+
+		if (entry->Hash == hash && strncmp(entry->Key, key, MDCACHE_KEY_MAX) == 0)
+		{
+			victim = entry;
+			break;
+		}
+
+		if (entry->Hash == 0 ||
+		    entry->Expires < now ||
+		    entry->Epoch != mdcache_header->Epoch)
+		{
+			if (!victim || victim->Hash != 0)
+				victim = entry;
+			continue;
+		}
+
+		if (!victim || entry->Expires < victim->Expires)
+			victim = entry;
+	}
+
+	if (!mdcache_lock(victim))
+		return;
+
+	victim->Hash    = hash;
+	victim->Epoch   = mdcache_header->Epoch;
+	victim->Expires = now + mdcache_ttl;
+	victim->Type    = Info->Type;
+	victim->Size    = Info->Size;
+	memcpy(victim->ETag, Info->ETag, MDCACHE_ETAG_MAX);
+	memcpy(victim->LastModified, Info->LastModified, MDCACHE_TIME_MAX);
+	memcpy(victim->Key, key, MDCACHE_KEY_MAX);
+
+	mdcache_unlock(victim);
+	MDCACHE_COUNT(Inserts);
+}
+
+static void
+mdcache_drop(ds3_client * Client, const char * Bucket, const char * Name)
+{
+	mdcache_entry_t * entry = NULL;
+	char              key[MDCACHE_KEY_MAX];
+	uint64_t          hash  = 0;
+	int               probe = 0;
+
+	if (!mdcache_key(Client, Bucket, Name, key, &hash))
+		return;
+
+	for (probe = 0; probe < MDCACHE_PROBES; probe++)
+	{
+		entry = mdcache_slot(hash, probe);
+		if (entry->Hash != hash)
+			continue;
+
+		/*
+		 * If another process holds the entry we can not drop it; flush
+		 * everything rather than leave it to the TTL.
+		 */
+		if (!mdcache_lock(entry))
+		{
+			mdcache_flush();
+			return;
+		}
+
+		if (strncmp(entry->Key, key, MDCACHE_KEY_MAX) == 0)
+		{
+			entry->Hash   = 0;
+			entry->Key[0] = '\0';
+			MDCACHE_COUNT(Invalidations);
+		}
+		mdcache_unlock(entry);
+	}
+}
+
+void
+mdcache_invalidate(ds3_client * Client, const char * Bucket, const char * Name)
+{
+	char   parent[MDCACHE_KEY_MAX];
+	size_t length = strlen(Name);
+
+	if (!mdcache_header)
+		return;
+
+	mdcache_drop(Client, Bucket, Name);
+
+	/* The directory holding Name, with its trailing '/'. */
+	if (length && Name[length - 1] == '/')
+		length--;
+	while (length && Name[length - 1] != '/')
+		length--;
+
+	if (length && length < sizeof(parent))
+	{
+		memcpy(parent, Name, length);
+		parent[length] = '\0';
+		mdcache_drop(Client, Bucket, parent);
+	}
+}
+
+void
+mdcache_flush()
+{
+	if (!mdcache_header)
+		return;
+
+	__sync_fetch_and_add(&mdcache_header->Epoch, 1);
+	MDCACHE_COUNT(Flushes);
+}
+
+int
+mdcache_get_stats(mdcache_stats_t * Stats)
+{
+	memset(Stats, 0, sizeof(mdcache_stats_t));
+
+	if (!mdcache_header)
+		return 0;
+
+	*Stats = mdcache_header->Stats;
+	return 1;
+}
@@ -0,0 +1,131 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * Object and directory metadata shared by one user's server processes on
+ * this host. The cache is a fixed hash table in an mmap'd file. Each entry has
+ * a sequence number: writers make it odd while they change the entry, and
+ * readers copy the entry and retry if the number moved. Entries expire after
+ * the TTL. STOR, DELE and MKD drop the entries they change; RMD and bucket
+ * deletes drop everything by bumping the table's epoch.
+ *
+ * Each user gets their own file, mode 0600, so no one else can plant
+ * entries. Keys still include the DS3 access ID for users who switch
+ * credentials. A threaded server runs every session as one user and keeps
+ * the first session's file.
+ */
+
+#ifndef BLACKPEARL_DSI_MDCACHE_H
+#define BLACKPEARL_DSI_MDCACHE_H
+
+/*
+ * System includes
+ */
+#include <stdint.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * DS3 includes
+ */
+#include <ds3.h>
+
+#define MDCACHE_ENTRIES   16384
+#define MDCACHE_PROBES    4
+#define MDCACHE_KEY_MAX   512
+#define MDCACHE_ETAG_MAX  64
+#define MDCACHE_TIME_MAX  32
+
+typedef enum {
+	MDCACHE_OBJECT    = 1,
+	MDCACHE_DIRECTORY = 2,
+} mdcache_type_t;
+
+typedef struct {
+	mdcache_type_t Type;
+	uint64_t       Size;
+	char           ETag[MDCACHE_ETAG_MAX];         // "" if none
+	char           LastModified[MDCACHE_TIME_MAX]; // "" if none
+} mdcache_info_t;
+
+/* Totals across every process sharing the file. */
+typedef struct {
+	uint64_t Hits;
+	uint64_t Misses;        // Including stale entries
+	uint64_t Stale;         // Found but past the TTL
+	uint64_t Inserts;
+	uint64_t Invalidations;
+	uint64_t Flushes;
+} mdcache_stats_t;
+
+/* Maps the cache at Path.UserName. Once per process; later calls do nothing. */
+globus_result_t
+mdcache_init(const char * Path, const char * UserName, int TTL);
+
+/* 1 = Name (with a trailing '/' for directories) was found in Bucket. */
+int
+mdcache_lookup(ds3_client     * Client,
+               const char     * Bucket,
+               const char     * Name,
+               mdcache_info_t * Info);
+
+void
+mdcache_insert(ds3_client     * Client,
+               const char     * Bucket,
+               const char     * Name,
+               mdcache_info_t * Info);
+
+/* Drops Name and the directory holding it. */
+void
+mdcache_invalidate(ds3_client * Client, const char * Bucket, const char * Name);
+
+/* Drops every entry. */
+void
+mdcache_flush();
+
+/* 0 = no cache is mapped. */
+int
+mdcache_get_stats(mdcache_stats_t * Stats);
+
+#endif /* BLACKPEARL_DSI_MDCACHE_H */
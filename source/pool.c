@@ -0,0 +1,210 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * System includes
+ */
+#include <sys/mman.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * Local includes
+ */
+#include "pool.h"
+
+/* Free buffers link through their first bytes. */
+typedef struct pool_block {
+	struct pool_block * Next;
+} pool_block_t;
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pool_block_t  * pool_free[POOL_MAX_SHIFT + 1];
+static int             pool_huge_pages = 0;
+static pool_stats_t    pool_stats;
+
+void
+pool_set_huge_pages(int Enable)
+{
+	pthread_mutex_lock(&pool_mutex);
+	pool_huge_pages = Enable;
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+/* Returns the size class for Size or -1 if it is too large. */
+static int
+pool_size_class(size_t Size)
+{
+	int shift = POOL_MIN_SHIFT;
+
+	while (shift <= POOL_MAX_SHIFT && ((size_t)1 << shift) < Size)
+		shift++;
+
+	if (shift > POOL_MAX_SHIFT)
+		return -1;
+	return shift;
+}
+
+globus_result_t
+pool_get(size_t Size, char ** Buffer)
+{
+	pool_block_t * block      = NULL;
+	size_t         class_size = 0;
+	int            shift      = 0;
+	int            huge       = 0;
+
+	GlobusGFSName(pool_get);
+
+	*Buffer = NULL;
+
+	shift = pool_size_class(Size);
+	if (shift < 0)
+		return GlobusGFSErrorGeneric("Buffer size is too large for the buffer pool");
+	class_size = (size_t)1 << shift;
+
+	pthread_mutex_lock(&pool_mutex);
+	{
+		block = pool_free[shift];
+		if (block)
+		{
+			pool_free[shift] = block->Next;
+			pool_stats.Hits++;
+			pool_stats.CachedBytes -= class_size;
+		} else
+			pool_stats.Misses++;
+
+		pool_stats.InUseBytes += class_size;
+		huge = pool_huge_pages;
+	}
+	pthread_mutex_unlock(&pool_mutex);
+
+	if (block)
+	{
+		*Buffer = (char *)block;
+		return GLOBUS_SUCCESS;
+	}
+
+	block = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	if (huge && class_size >= POOL_HUGE_PAGE_SIZE)
+		block = mmap(NULL,
+		             class_size,
+		             PROT_READ|PROT_WRITE,
+		             MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,
+		             -1,
+		             0);
+#endif /* MAP_HUGETLB */
+
+	/* No huge pages reserved; fall back to normal pages. */
+	if (block == MAP_FAILED)
+		block = mmap(NULL,
+		             class_size,
+		             PROT_READ|PROT_WRITE,
+		             MAP_PRIVATE|MAP_ANONYMOUS,
+		             -1,
+		             0);
+
+	if (block == MAP_FAILED)
+	{
+		pthread_mutex_lock(&pool_mutex);
+		pool_stats.InUseBytes -= class_size;
+		pthread_mutex_unlock(&pool_mutex);
+		return GlobusGFSErrorMemory("pool buffer");
+	}
+
+	*Buffer = (char *)block;
+	return GLOBUS_SUCCESS;
+}
+
+void
+pool_put(char * Buffer, size_t Size)
+{
+	pool_block_t * block      = (pool_block_t *)Buffer;
+	size_t         class_size = 0;
+	int            shift      = 0;
+
+	if (!Buffer)
+		return;
+
+	shift      = pool_size_class(Size);
+	class_size = (size_t)1 << shift;
+
+	pthread_mutex_lock(&pool_mutex);
+	{
+		pool_stats.InUseBytes -= class_size;
+
+		if (pool_stats.CachedBytes + class_size <= POOL_MAX_CACHED)
+		{
+			block->Next      = pool_free[shift];
+			pool_free[shift] = block;
+			pool_stats.CachedBytes += class_size;
+			block = NULL;
+		}
+	}
+	pthread_mutex_unlock(&pool_mutex);
+
+	if (block)
+		munmap(block, class_size);
+}
+
+size_t
+pool_class_size(size_t Size)
+{
+	int shift = pool_size_class(Size);
+
+	if (shift < 0)
+		return Size;
+	return (size_t)1 << shift;
+}
+
+void
+pool_get_stats(pool_stats_t * Stats)
+{
+	pthread_mutex_lock(&pool_mutex);
+	*Stats = pool_stats;
+	pthread_mutex_unlock(&pool_mutex);
+}
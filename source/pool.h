@@ -0,0 +1,98 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * Process-wide pool of data buffers shared by STOR and RETR. Buffers are
+ * kept in power-of-two size classes and reused across transfers so each file
+ * does not pay to allocate and fault in its buffers again.
+ */
+
+#ifndef BLACKPEARL_DSI_POOL_H
+#define BLACKPEARL_DSI_POOL_H
+
+/*
+ * System includes
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/* Smallest size class, one page. */
+#define POOL_MIN_SHIFT      12
+/* Largest size class, 1GB. */
+#define POOL_MAX_SHIFT      30
+/* Size classes at least this large try huge pages when enabled. */
+#define POOL_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+/* Free buffers beyond this many bytes are returned to the system. */
+#define POOL_MAX_CACHED     (256 * 1024 * 1024)
+
+typedef struct {
+	uint64_t Hits;        // Requests served from the pool
+	uint64_t Misses;      // Requests that mapped a new buffer
+	uint64_t CachedBytes; // Free bytes held by the pool
+	uint64_t InUseBytes;  // Bytes handed out and not yet returned
+} pool_stats_t;
+
+void
+pool_set_huge_pages(int Enable);
+
+/*
+ * Buffers are page aligned and at least Size bytes long. Return them with
+ * the same Size.
+ */
+globus_result_t
+pool_get(size_t Size, char ** Buffer);
+
+void
+pool_put(char * Buffer, size_t Size);
+
+/* Bytes pool_get() really maps for Size: its size class, or Size if too large. */
+size_t
+pool_class_size(size_t Size);
+
+void
+pool_get_stats(pool_stats_t * Stats);
+
+#endif /* BLACKPEARL_DSI_POOL_H */
@@ -42,7 +42,10 @@
 /*
  * System includes
  */
+#include <sys/select.h>
 #include <pthread.h>
+#include <assert.h>
+#include <time.h>
 
 /*
  * Globus includes
@@ -60,8 +63,35 @@
 #include "retr.h"
 #include "gds3.h"
 #include "path.h"
-#include "stat.h"
 #include "markers.h"
+#include "pool.h"
+#include "governor.h"
+#include "workers.h"
+#include "error.h"
+
+/*
+ * Called locked. Returns a written buffer to the free list or, if this
+ * transfer holds more than its share of the buffer budget or more than its
+ * target depth needs, to the pool.
+ */
+static void
+retr_release_buffer(retr_info_t * RetrInfo, retr_buffer_t * RetrBuffer)
+{
+	if (RetrInfo->AllBuffers.Count <= RetrInfo->Depth.Target +
+	                                  RetrInfo->PendingBuffers.Count +
+	                                  RetrInfo->StreamCnt &&
+	    !governor_over_share(&RetrInfo->Share))
+	{
+		bufq_stack_push(&RetrInfo->FreeBuffers, &RetrBuffer->Entry);
+		return;
+	}
+
+	bufq_list_remove(&RetrInfo->AllBuffers, &RetrBuffer->AllLink);
+
+	pool_put(RetrBuffer->Buffer, RetrInfo->BlockSize);
+	governor_release(&RetrInfo->Share, RetrInfo->BufferSize);
+	globus_free(RetrBuffer);
+}
 
 void
 retr_gridftp_callout(globus_gfs_operation_t Operation,
@@ -70,71 +100,207 @@ retr_gridftp_callout(globus_gfs_operation_t Operation,
                      globus_size_t          Length,
                      void                 * UserArg)
 {
-	retr_info_t * retr_info = UserArg;
+	retr_buffer_t * retr_buffer = UserArg;
+	retr_info_t   * retr_info   = retr_buffer->RetrInfo;
 
 	pthread_mutex_lock(&retr_info->Mutex);
 	{
 		if (!retr_info->Result)
 			retr_info->Result = Result;
-		globus_list_insert(&retr_info->FreeBufferList, (char *)Buffer);
-		pthread_cond_signal(&retr_info->Cond);
+		retr_info->WriteCnt--;
+		depth_drained(&retr_info->Depth, Length);
+		retr_release_buffer(retr_info, retr_buffer);
+		pthread_cond_broadcast(&retr_info->Cond);
 	}
 	pthread_mutex_unlock(&retr_info->Mutex);
 }
 
+/*
+ * Called locked. In stream mode, the stream whose chunk holds WriteOffset
+ * is the only one the client can currently accept data from.
+ */
+static int
+retr_stream_is_head(retr_stream_t * RetrStream)
+{
+	retr_info_t * retr_info = RetrStream->RetrInfo;
+
+	if (!retr_info->InOrder)
+		return 1;
+	return (RetrStream->ChunkOffset <= retr_info->WriteOffset);
+}
+
 /*
  * Called locked.
  */
 globus_result_t
-retr_get_free_buffer(retr_info_t *  RetrInfo,
-                     char        ** FreeBuffer)
+retr_get_free_buffer(retr_stream_t  * RetrStream,
+                     retr_buffer_t ** FreeBuffer)
 {
-	int all_buf_cnt  = 0;
-	int free_buf_cnt = 0;
+	retr_info_t   * retr_info   = RetrStream->RetrInfo;
+	retr_buffer_t * retr_buffer = NULL;
+	globus_result_t result      = GLOBUS_SUCCESS;
+	int             pending_cnt = 0;
 
 	GlobusGFSName(retr_get_free_buffer);
 
-	/*
-	 * Check for the optimal number of concurrent writes.
-	 */
-	if (RetrInfo->ConnChkCnt++ == 0)
-		globus_gridftp_server_get_optimal_concurrency(RetrInfo->Operation,
-		                                             &RetrInfo->OptConnCnt);
-	if (RetrInfo->ConnChkCnt >= 100) RetrInfo->ConnChkCnt = 0;
-
 	/*
 	 * Wait for a free buffer or wait until conditions are right to create one.
+	 * Every stream may hold one fill buffer, and buffers parked for the
+	 * reorder window do not count against the writes in flight.
 	 */
 	while (1)
 	{
 		/* Check for error first. */
-		if (RetrInfo->Result)
-			return RetrInfo->Result;
+		if (retr_info->Result)
+			return retr_info->Result;
 
-		all_buf_cnt  = globus_list_size(RetrInfo->AllBufferList);
-		free_buf_cnt = globus_list_size(RetrInfo->FreeBufferList);
+		pending_cnt = retr_info->PendingBuffers.Count;
+		if (pending_cnt > RETR_REORDER_WINDOW)
+			pending_cnt = RETR_REORDER_WINDOW;
 
-		/* If we have a free buffer... */
-		if (free_buf_cnt) break;
-		/* If we can create another free buffer... */
-		if (all_buf_cnt < RetrInfo->OptConnCnt) break;
+		/* Streams ahead of the client wait while the window is full. */
+		if (retr_stream_is_head(RetrStream) ||
+		    retr_info->PendingBuffers.Count < RETR_REORDER_WINDOW)
+		{
+			/* If we have a free buffer... */
+			if (retr_info->FreeBuffers.Count)
+				break;
+			/*
+			 * If we can create another free buffer... Over budget, we wait for
+			 * our writes in flight to come back. If there are none, the
+			 * governor lets us have one more so the transfer keeps moving.
+			 */
+			if (retr_info->AllBuffers.Count < retr_info->Depth.Target + pending_cnt + retr_info->StreamCnt &&
+			    governor_reserve(&retr_info->Share,
+			                     retr_info->BufferSize,
+			                     retr_info->AllBuffers.Count < retr_info->PendingBuffers.Count + retr_info->StreamCnt + 1))
+				break;
+		}
 
-		pthread_cond_wait(&RetrInfo->Cond, &RetrInfo->Mutex);
+		pthread_cond_wait(&retr_info->Cond, &retr_info->Mutex);
 	}
 
-	if (!globus_list_empty(RetrInfo->FreeBufferList))
+	if (retr_info->FreeBuffers.Count)
 	{
-		*FreeBuffer = globus_list_remove(&RetrInfo->FreeBufferList, RetrInfo->FreeBufferList);
+		*FreeBuffer = bufq_container(bufq_stack_pop(&retr_info->FreeBuffers),
+		                             retr_buffer_t,
+		                             Entry);
 		return GLOBUS_SUCCESS;
 	}
 
-	*FreeBuffer = globus_malloc(RetrInfo->BlockSize);
-	if (!*FreeBuffer)
-		return GlobusGFSErrorMemory("free_buffer");
-	globus_list_insert(&RetrInfo->AllBufferList, *FreeBuffer);
+	retr_buffer = globus_malloc(sizeof(retr_buffer_t));
+	if (!retr_buffer)
+	{
+		governor_release(&retr_info->Share, retr_info->BufferSize);
+		return GlobusGFSErrorMemory("retr_buffer_t");
+	}
+
+	result = pool_get(retr_info->BlockSize, &retr_buffer->Buffer);
+	if (result)
+	{
+		governor_release(&retr_info->Share, retr_info->BufferSize);
+		globus_free(retr_buffer);
+		return result;
+	}
+	retr_buffer->RetrInfo = retr_info;
+
+	bufq_list_insert(&retr_info->AllBuffers, &retr_buffer->AllLink);
+
+	*FreeBuffer = retr_buffer;
+	return GLOBUS_SUCCESS;
+}
+
+/*
+ * Called locked.
+ */
+static globus_result_t
+retr_register_write(retr_info_t * RetrInfo, retr_buffer_t * RetrBuffer)
+{
+	globus_result_t result = GLOBUS_SUCCESS;
+
+	result = globus_gridftp_server_register_write(RetrInfo->Operation,
+	                                              (globus_byte_t *)RetrBuffer->Buffer,
+	                                              RetrBuffer->Length,
+	                                              RetrBuffer->Offset,
+	                                              0,
+	                                              retr_gridftp_callout,
+	                                              RetrBuffer);
+	if (result)
+	{
+		/* Give it back so retr_wait_for_gridftp() can account for it. */
+		bufq_stack_push(&RetrInfo->FreeBuffers, &RetrBuffer->Entry);
+		return result;
+	}
+
+	/* The data channels had run dry waiting on DS3. */
+	if (RetrInfo->WriteCnt++ == 0)
+		depth_stalled(&RetrInfo->Depth, governor_over_share(&RetrInfo->Share));
+	depth_filled(&RetrInfo->Depth, RetrBuffer->Length);
+
+	/* Wake a parked stream if we may run one more. */
+	if (aimd_bytes(&RetrInfo->Aimd, RetrBuffer->Length))
+		pthread_cond_broadcast(&RetrInfo->Cond);
+
+	/* Update perf markers */
+	markers_update_perf_markers(RetrInfo->Operation,
+	                            RetrBuffer->Offset,
+	                            RetrBuffer->Length);
+	RetrInfo->LastMarker = time(NULL);
+
+	if (RetrInfo->WriteOffset == RetrBuffer->Offset)
+		RetrInfo->WriteOffset += RetrBuffer->Length;
+
 	return GLOBUS_SUCCESS;
 }
 
+/*
+ * Called locked. Hands the stream's fill buffer to GridFTP. In stream mode,
+ * a buffer ahead of WriteOffset is parked until the gap before it is written.
+ */
+globus_result_t
+retr_flush_buffer(retr_stream_t * RetrStream)
+{
+	retr_info_t   * retr_info   = RetrStream->RetrInfo;
+	retr_buffer_t * retr_buffer = RetrStream->FillBuffer;
+	bufq_entry_t  * pending     = NULL;
+	globus_result_t result      = GLOBUS_SUCCESS;
+
+	if (!retr_buffer)
+		return GLOBUS_SUCCESS;
+
+	RetrStream->FillBuffer = NULL;
+
+	if (retr_info->InOrder && retr_buffer->Offset != retr_info->WriteOffset)
+	{
+		bufq_table_insert(&retr_info->PendingBuffers, &retr_buffer->Entry, retr_buffer->Offset);
+		return GLOBUS_SUCCESS;
+	}
+
+	result = retr_register_write(retr_info, retr_buffer);
+
+	/* Release any parked buffers that are now in order. */
+	while (!result && retr_info->InOrder && retr_info->PendingBuffers.Count)
+	{
+		pending = bufq_table_remove(&retr_info->PendingBuffers, retr_info->WriteOffset);
+		if (!pending)
+			break;
+
+		retr_buffer = bufq_container(pending, retr_buffer_t, Entry);
+
+		result = retr_register_write(retr_info, retr_buffer);
+	}
+
+	/* WriteOffset moved; a waiting stream may now be the head. */
+	if (retr_info->InOrder)
+		pthread_cond_broadcast(&retr_info->Cond);
+
+	return result;
+}
+
+/*
+ * libcurl hands us data in small pieces. Collect them into BlockSize
+ * buffers so each register_write() moves a full GridFTP block.
+ */
 size_t
 retr_ds3_callout(void * ReadyBuffer,
                  size_t Length,
@@ -142,72 +308,135 @@ retr_ds3_callout(void * ReadyBuffer,
                  void * UserArg)
 {
 	globus_result_t result      = GLOBUS_SUCCESS;
-	retr_info_t   * retr_info   = UserArg;
-	char          * free_buffer = NULL;
+	retr_stream_t * retr_stream = UserArg;
+	retr_info_t   * retr_info   = retr_stream->RetrInfo;
+	retr_buffer_t * fill_buffer = NULL;
 	int             rc          = Length * Nmemb;
 	int             buf_offset  = 0;
 	int             cpy_length  = 0;
 
 	GlobusGFSName(retr_ds3_callout);
 
-	pthread_mutex_lock(&retr_info->Mutex);
+	/*
+	 * The fill buffer belongs to this stream until it is flushed, so the
+	 * copy runs unlocked. We only take the lock to trade buffers with GridFTP.
+	 */
+	if (retr_stream->Offset + Length*Nmemb > retr_stream->EndOffset)
+	{
+		pthread_mutex_lock(&retr_info->Mutex);
+		if (!retr_info->Result)
+			retr_info->Result = GlobusGFSErrorGeneric("Received more data than requested from DS3");
+		pthread_mutex_unlock(&retr_info->Mutex);
+		return -1;
+	}
+
+	/* Time to first byte tells us how loaded the BlackPearl is. */
+	if (retr_stream->Requested.tv_sec)
 	{
-		while (buf_offset != (Length*Nmemb))
+		pthread_mutex_lock(&retr_info->Mutex);
+		aimd_latency(&retr_info->Aimd, &retr_stream->Requested);
+		pthread_mutex_unlock(&retr_info->Mutex);
+		retr_stream->Requested.tv_sec = 0;
+	}
+
+	while (buf_offset != (Length*Nmemb))
+	{
+		if (!retr_stream->FillBuffer)
 		{
-			result = retr_get_free_buffer(retr_info, &free_buffer);
-			if (result)
+			pthread_mutex_lock(&retr_info->Mutex);
 			{
-				rc = 1; /* Signal to shutdown. */
-				if (!retr_info->Result) retr_info->Result = result;
-				goto cleanup;
+				result = retr_get_free_buffer(retr_stream, &retr_stream->FillBuffer);
+				if (result && !retr_info->Result)
+					retr_info->Result = result;
 			}
+			pthread_mutex_unlock(&retr_info->Mutex);
 
-			cpy_length = (Length*Nmemb) - buf_offset;
-			if (cpy_length > retr_info->BlockSize)
-				cpy_length = retr_info->BlockSize;
+			if (result)
+				return 1; /* Signal to shutdown. */
 
-			memcpy(free_buffer, ReadyBuffer + buf_offset, cpy_length);
+			retr_stream->FillBuffer->Offset = retr_stream->Offset;
+			retr_stream->FillBuffer->Length = 0;
+		}
+		fill_buffer = retr_stream->FillBuffer;
 
-			result = globus_gridftp_server_register_write(retr_info->Operation,
-			                                              free_buffer,
-			                                              cpy_length,
-			                                              retr_info->Offset,
-			                                              0,
-			                                              retr_gridftp_callout,
-			                                              retr_info);
+		cpy_length = (Length*Nmemb) - buf_offset;
+		if (cpy_length > retr_info->BlockSize - fill_buffer->Length)
+			cpy_length = retr_info->BlockSize - fill_buffer->Length;
 
-			if (result)
+		memcpy(fill_buffer->Buffer + fill_buffer->Length,
+		       ReadyBuffer + buf_offset,
+		       cpy_length);
+
+		fill_buffer->Length += cpy_length;
+		retr_stream->Offset += cpy_length;
+		buf_offset          += cpy_length;
+
+		if (fill_buffer->Length == retr_info->BlockSize)
+		{
+			pthread_mutex_lock(&retr_info->Mutex);
 			{
-				if(!retr_info->Result) retr_info->Result = result;
-				rc = -1;
-				goto cleanup;
+				result = retr_flush_buffer(retr_stream);
+				if (result && !retr_info->Result)
+					retr_info->Result = result;
 			}
+			pthread_mutex_unlock(&retr_info->Mutex);
 
-			/* Update perf markers */
-			markers_update_perf_markers(retr_info->Operation, 
-			                            retr_info->Offset,
-			                            cpy_length);
-
-			retr_info->Offset += cpy_length;
-			buf_offset        += cpy_length;
+			if (result)
+				return -1;
 		}
 	}
-cleanup:
-	pthread_mutex_unlock(&retr_info->Mutex);
 
 	return rc;
 }
 
+/*
+ * Writes out a partial fill buffer at the end of a chunk.
+ */
+globus_result_t
+retr_end_of_chunk(retr_stream_t * RetrStream)
+{
+	retr_info_t   * retr_info = RetrStream->RetrInfo;
+	globus_result_t result    = GLOBUS_SUCCESS;
+
+	pthread_mutex_lock(&retr_info->Mutex);
+	{
+		result = retr_flush_buffer(RetrStream);
+		if (!retr_info->Result)
+			retr_info->Result = result;
+		result = retr_info->Result;
+	}
+	pthread_mutex_unlock(&retr_info->Mutex);
+
+	return result;
+}
+
 void
 retr_wait_for_gridftp(retr_info_t * RetrInfo)
 {
+	retr_buffer_t * retr_buffer = NULL;
+	bufq_entry_t  * pending     = NULL;
+	int             i           = 0;
+
 	pthread_mutex_lock(&RetrInfo->Mutex);
 	{
-		while (1)
+		/* On error, partially filled and parked buffers are never written. */
+		for (i = 0; i < RetrInfo->StreamCnt; i++)
+		{
+			retr_buffer = RetrInfo->Streams[i].FillBuffer;
+			if (retr_buffer)
+				bufq_stack_push(&RetrInfo->FreeBuffers, &retr_buffer->Entry);
+			RetrInfo->Streams[i].FillBuffer = NULL;
+		}
+
+		while ((pending = bufq_table_pop(&RetrInfo->PendingBuffers)))
 		{
-			if (RetrInfo->Result) break;
+			bufq_stack_push(&RetrInfo->FreeBuffers, pending);
+		}
 
-			if (globus_list_size(RetrInfo->AllBufferList) == globus_list_size(RetrInfo->FreeBufferList))
+		while (1)
+		{
+			/* Every write gets its callback, even on error. */
+			if (RetrInfo->AllBuffers.Count == RetrInfo->FreeBuffers.Count)
 				break;
 
 			pthread_cond_wait(&RetrInfo->Cond, &RetrInfo->Mutex);
@@ -216,55 +445,468 @@ retr_wait_for_gridftp(retr_info_t * RetrInfo)
 	pthread_mutex_unlock(&RetrInfo->Mutex);
 }
 
+static void
+retr_free_buffer(retr_buffer_t * RetrBuffer)
+{
+	pool_put(RetrBuffer->Buffer, RetrBuffer->RetrInfo->BlockSize);
+	globus_free(RetrBuffer);
+}
+
 void
 retr_destroy_info(retr_info_t * RetrInfo)
 {
+	bufq_link_t * link = NULL;
+
 	if (RetrInfo)
 	{
 		if (RetrInfo->Object) free(RetrInfo->Object);
 		if (RetrInfo->Bucket) free(RetrInfo->Bucket);
+		if (RetrInfo->Streams) free(RetrInfo->Streams);
 		pthread_mutex_destroy(&RetrInfo->Mutex);
 		pthread_cond_destroy(&RetrInfo->Cond);
-		globus_list_free(RetrInfo->FreeBufferList);
-		globus_list_destroy_all(RetrInfo->AllBufferList, free);
+		while ((link = bufq_list_pop(&RetrInfo->AllBuffers)))
+		{
+			retr_free_buffer(bufq_container(link, retr_buffer_t, AllLink));
+		}
+		governor_leave(&RetrInfo->Share);
 		free(RetrInfo);
 	}
 }
 
+/*
+ * Called unlocked. Asks BlackPearl which chunks of the job are in cache. If
+ * none have arrived since the last poll, waits out the retry interval while
+ * keeping the control channel alive with perf markers.
+ */
+static globus_result_t
+retr_poll_available_chunks(retr_info_t * RetrInfo)
+{
+	ds3_get_available_chunks_response * chunk_response = NULL;
+	ds3_bulk_response                 * bulk_response  = RetrInfo->BulkResponse;
+	ds3_bulk_object_list              * chunk          = NULL;
+	globus_result_t                     result         = GLOBUS_SUCCESS;
+	uint64_t                            retry_after    = 0;
+	int                                 found          = 0;
+	int                                 i              = 0;
+	int                                 j              = 0;
+	struct timeval                      tv;
+
+	result = gds3_available_chunks(RetrInfo->Client,
+	                               bulk_response->job_id,
+	                               &chunk_response);
+	if (result)
+		return result;
+
+	pthread_mutex_lock(&RetrInfo->Mutex);
+	{
+		for (j = 0; chunk_response->object_list && j < chunk_response->object_list->list_size; j++)
+		{
+			chunk = chunk_response->object_list->list[j];
+			assert(chunk->size == 1);
+
+			for (i = 0; i < bulk_response->list_size; i++)
+			{
+				if (bulk_response->list[i]->list[0].offset == chunk->list[0].offset)
+				{
+					if (!RetrInfo->ChunkAvailable[i])
+						found++;
+					RetrInfo->ChunkAvailable[i] = 1;
+					break;
+				}
+			}
+		}
+	}
+	pthread_mutex_unlock(&RetrInfo->Mutex);
+
+	retry_after = chunk_response->retry_after;
+	ds3_free_available_chunks_response(chunk_response);
+
+	if (found)
+		return GLOBUS_SUCCESS;
+
+	if (retry_after < 1)
+		retry_after = 1;
+
+	while (retry_after-- && !RetrInfo->Result)
+	{
+		// Sleep for 1.0 sec
+		tv.tv_sec  = 1;
+		tv.tv_usec = 0;
+		select(0, NULL, NULL, NULL, &tv);
+
+		/*
+		 * Nothing has been sent while we wait on tape. Bytes that are only
+		 * staged have not reached the client, so the keep-alive marker
+		 * carries no new bytes.
+		 */
+		pthread_mutex_lock(&RetrInfo->Mutex);
+		if (RetrInfo->MarkerFreq && (time(NULL) - RetrInfo->LastMarker) >= RetrInfo->MarkerFreq)
+		{
+			markers_update_perf_markers(RetrInfo->Operation, RetrInfo->WriteOffset, 0);
+			RetrInfo->LastMarker = time(NULL);
+		}
+		pthread_mutex_unlock(&RetrInfo->Mutex);
+	}
+
+	return GLOBUS_SUCCESS;
+}
+
+/*
+ * Called locked. Returns the index of the next chunk to retrieve or -1 when
+ * there are none left. In order, chunks are taken in job order. Otherwise
+ * they are taken as they become available in the BlackPearl cache.
+ */
+static int
+retr_next_chunk(retr_info_t * RetrInfo)
+{
+	ds3_bulk_response * bulk_response = RetrInfo->BulkResponse;
+	globus_result_t     result        = GLOBUS_SUCCESS;
+	int                 unclaimed     = 0;
+	int                 i             = 0;
+
+	if (RetrInfo->InOrder)
+	{
+		if (RetrInfo->NextChunk < bulk_response->list_size && !RetrInfo->Result)
+			return RetrInfo->NextChunk++;
+		return -1;
+	}
+
+	while (!RetrInfo->Result)
+	{
+		unclaimed = 0;
+		for (i = 0; i < bulk_response->list_size; i++)
+		{
+			if (RetrInfo->ChunkClaimed[i])
+				continue;
+
+			if (RetrInfo->ChunkAvailable[i])
+			{
+				RetrInfo->ChunkClaimed[i] = 1;
+				return i;
+			}
+			unclaimed++;
+		}
+
+		if (!unclaimed)
+			break;
+
+		if (RetrInfo->Polling)
+		{
+			pthread_cond_wait(&RetrInfo->Cond, &RetrInfo->Mutex);
+			continue;
+		}
+
+		RetrInfo->Polling = GLOBUS_TRUE;
+		pthread_mutex_unlock(&RetrInfo->Mutex);
+		result = retr_poll_available_chunks(RetrInfo);
+		pthread_mutex_lock(&RetrInfo->Mutex);
+		RetrInfo->Polling = GLOBUS_FALSE;
+
+		if (result && !RetrInfo->Result)
+			RetrInfo->Result = result;
+		pthread_cond_broadcast(&RetrInfo->Cond);
+	}
+
+	return -1;
+}
+
+/* Called locked. 1 = some chunk of the range has not been claimed. */
+static int
+retr_chunks_left(retr_info_t * RetrInfo)
+{
+	int i = 0;
+
+	if (RetrInfo->InOrder)
+		return (RetrInfo->NextChunk < RetrInfo->BulkResponse->list_size);
+
+	for (i = 0; i < RetrInfo->BulkResponse->list_size; i++)
+	{
+		if (!RetrInfo->ChunkClaimed[i])
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Retrieves chunks until there are none left. Each stream takes the next
+ * unclaimed chunk, so several GETs from the job are in flight at once.
+ * Streams numbered past the controller's target park between chunks.
+ */
 void *
-retr_thread(void * UserArg)
+retr_stream_thread(void * UserArg)
+{
+	ds3_bulk_response * bulk_response = NULL;
+	globus_result_t     result        = GLOBUS_SUCCESS;
+	retr_stream_t     * retr_stream   = UserArg;
+	retr_info_t       * retr_info     = retr_stream->RetrInfo;
+	uint64_t            chunk_offset  = 0;
+	uint64_t            chunk_length  = 0;
+	int                 busy          = 0;
+	int                 i             = 0;
+	struct timeval      tv;
+
+	bulk_response = retr_info->BulkResponse;
+
+	while (1)
+	{
+		pthread_mutex_lock(&retr_info->Mutex);
+		{
+			while (retr_stream - retr_info->Streams >= retr_info->Aimd.Target &&
+			       !retr_info->Result &&
+			       retr_chunks_left(retr_info))
+				pthread_cond_wait(&retr_info->Cond, &retr_info->Mutex);
+
+			i = retr_next_chunk(retr_info);
+
+			/* Parked streams exit once every chunk is claimed. */
+			if (!retr_chunks_left(retr_info))
+				pthread_cond_broadcast(&retr_info->Cond);
+
+			if (i >= 0)
+			{
+				assert(bulk_response->list[i]->size == 1);
+
+				/*
+				 * bulk_response returns chunks that contain the offsets we
+				 * need. Only ask for the part of the chunk in our range.
+				 */
+				chunk_offset = bulk_response->list[i]->list[0].offset;
+				chunk_length = bulk_response->list[i]->list[0].length;
+
+				retr_stream->ChunkOffset = chunk_offset;
+				if (retr_stream->ChunkOffset < retr_info->RangeOffset)
+					retr_stream->ChunkOffset = retr_info->RangeOffset;
+
+				retr_stream->EndOffset = chunk_offset + chunk_length;
+				if (retr_stream->EndOffset > retr_info->RangeOffset + retr_info->RangeLength)
+					retr_stream->EndOffset = retr_info->RangeOffset + retr_info->RangeLength;
+
+				retr_stream->Offset = retr_stream->ChunkOffset;
+			}
+		}
+		pthread_mutex_unlock(&retr_info->Mutex);
+
+		if (i < 0)
+			break;
+
+		if (retr_stream->EndOffset <= retr_stream->ChunkOffset)
+			continue;
+
+		while (1)
+		{
+			clock_gettime(CLOCK_MONOTONIC, &retr_stream->Requested);
+			result = gds3_get_object_for_job(retr_info->Client,
+			                                 retr_info->Bucket,
+			                                 retr_info->Object,
+			                                 chunk_offset,
+			                                 retr_stream->ChunkOffset - chunk_offset,
+			                                 retr_stream->EndOffset - retr_stream->ChunkOffset,
+			                                 bulk_response->job_id->value,
+			                                 retr_ds3_callout,
+			                                 retr_stream);
+			retr_stream->Requested.tv_sec = 0;
+			if (!error_is_busy(result))
+				break;
+
+			/* Turned away before any data arrived; back off and ask again. */
+			pthread_mutex_lock(&retr_info->Mutex);
+			busy = (!retr_info->Result && retr_stream->Offset == retr_stream->ChunkOffset);
+			if (busy)
+				aimd_congested(&retr_info->Aimd);
+			pthread_mutex_unlock(&retr_info->Mutex);
+
+			if (!busy)
+				break;
+
+			globus_object_free(globus_error_get(result));
+			result = GLOBUS_SUCCESS;
+
+			// Sleep for 1.0 sec
+			tv.tv_sec  = 1;
+			tv.tv_usec = 0;
+			select(0, NULL, NULL, NULL, &tv);
+		}
+		if (!result)
+			result = retr_end_of_chunk(retr_stream);
+		if (result)
+			break;
+	}
+
+	pthread_mutex_lock(&retr_info->Mutex);
+	{
+		if (!retr_info->Result)
+			retr_info->Result = result;
+		/* Release the other streams. */
+		if (retr_info->Result)
+			pthread_cond_broadcast(&retr_info->Cond);
+	}
+	pthread_mutex_unlock(&retr_info->Mutex);
+
+	return NULL;
+}
+
+/*
+ * Runs the chunks of BulkResponse across the configured number of streams.
+ */
+globus_result_t
+retr_run_streams(retr_info_t * RetrInfo, int MaxStreams)
 {
+	ds3_bulk_response * bulk_response = RetrInfo->BulkResponse;
+	int                 stream_cnt    = 0;
 	int                 i             = 0;
-	int                 last_loop     = 0;
+
+	GlobusGFSName(retr_run_streams);
+
+	/*
+	 * No point in more streams than chunks. MaxStreams is the most the
+	 * controller may run; every stream gets a thread up front and parks
+	 * until the controller lets it run.
+	 */
+	stream_cnt = MaxStreams;
+	if (stream_cnt > bulk_response->list_size)
+		stream_cnt = bulk_response->list_size;
+	if (stream_cnt < 1)
+		stream_cnt = 1;
+
+	RetrInfo->ChunkClaimed   = calloc(bulk_response->list_size, sizeof(char));
+	RetrInfo->ChunkAvailable = calloc(bulk_response->list_size, sizeof(char));
+	if (!RetrInfo->ChunkClaimed || !RetrInfo->ChunkAvailable)
+		return GlobusGFSErrorMemory("chunk list");
+
+	RetrInfo->NextChunk   = 0;
+	RetrInfo->WriteOffset = RetrInfo->RangeOffset;
+
+	/*
+	 * Stream 0 runs on this thread. If we can not launch the others, carry
+	 * on with the streams we have.
+	 */
+	pthread_mutex_lock(&RetrInfo->Mutex);
+	RetrInfo->StreamCnt = stream_cnt;
+	for (i = 0; i < stream_cnt; i++)
+	{
+		memset(&RetrInfo->Streams[i], 0, sizeof(retr_stream_t));
+		RetrInfo->Streams[i].RetrInfo = RetrInfo;
+		if (i > 0 && pthread_create(&RetrInfo->Streams[i].Thread,
+		                            NULL,
+		                            retr_stream_thread,
+		                            &RetrInfo->Streams[i]))
+			break;
+	}
+	RetrInfo->StreamCnt = i;
+	pthread_mutex_unlock(&RetrInfo->Mutex);
+
+	retr_stream_thread(&RetrInfo->Streams[0]);
+
+	for (i = 1; i < RetrInfo->StreamCnt; i++)
+	{
+		pthread_join(RetrInfo->Streams[i].Thread, NULL);
+	}
+
+	return RetrInfo->Result;
+}
+
+/*
+ * Small objects come back in one GET without a bulk job, skipping the job
+ * creation and availability round trips. Stream 0 fills buffers just as it
+ * would for a chunk.
+ */
+static globus_result_t
+retr_get_small_object(retr_info_t * RetrInfo)
+{
+	retr_stream_t * retr_stream = &RetrInfo->Streams[0];
+	globus_result_t result      = GLOBUS_SUCCESS;
+
+	pthread_mutex_lock(&RetrInfo->Mutex);
+	{
+		memset(retr_stream, 0, sizeof(retr_stream_t));
+		retr_stream->RetrInfo    = RetrInfo;
+		retr_stream->ChunkOffset = RetrInfo->RangeOffset;
+		retr_stream->Offset      = RetrInfo->RangeOffset;
+		retr_stream->EndOffset   = RetrInfo->RangeOffset + RetrInfo->RangeLength;
+
+		RetrInfo->StreamCnt   = 1;
+		RetrInfo->WriteOffset = RetrInfo->RangeOffset;
+	}
+	pthread_mutex_unlock(&RetrInfo->Mutex);
+
+	result = gds3_get_object_range(RetrInfo->Client,
+	                               RetrInfo->Bucket,
+	                               RetrInfo->Object,
+	                               RetrInfo->RangeOffset,
+	                               RetrInfo->RangeLength,
+	                               retr_ds3_callout,
+	                               retr_stream);
+	if (!result)
+		result = retr_end_of_chunk(retr_stream);
+	return result;
+}
+
+/*
+ * Sends each range the server asks for. Ranges come from REST markers and
+ * partial (ERET) offsets and are in terms of file offsets.
+ */
+void *
+retr_thread(void * UserArg)
+{
 	globus_off_t        offset        = 0;
 	globus_off_t        length        = 0;
+	globus_off_t        file_size     = -1;
 	globus_result_t     result        = GLOBUS_SUCCESS;
 	retr_info_t       * retr_info     = UserArg;
-	ds3_bulk_response * bulk_response = NULL;
+	ds3_object        * object        = NULL;
+
+	GlobusGFSName(retr_thread);
 
 	globus_gridftp_server_begin_transfer(retr_info->Operation, 0, NULL);
 
-	while (!last_loop)
+	while (1)
 	{
-		globus_gridftp_server_get_write_range(retr_info->Operation,
-		                                      &offset,
-		                                      &length);
+		globus_gridftp_server_get_read_range(retr_info->Operation,
+		                                     &offset,
+		                                     &length);
 		if (length == 0)
 			break;
 
+		/* -1 means to the end of the file. */
 		if (length == -1)
 		{
-			globus_gfs_stat_t gfs_stat;
-			result = stat_entry(retr_info->Client,
-			                    retr_info->TransferInfo->pathname,
-			                    &gfs_stat);
+			/*
+			 * Not from the metadata cache; an overwrite elsewhere would
+			 * leave it stale and we would send the wrong length.
+			 */
+			if (file_size == -1)
+			{
+				result = gds3_get_object_uncached(retr_info->Client,
+				                                  retr_info->Bucket,
+				                                  retr_info->Object,
+				                                  &object);
+				if (result)
+					break;
+				if (!object)
+				{
+					result = GlobusGFSErrorGeneric("No such object");
+					break;
+				}
+
+				file_size = object->size;
+				gds3_free_object(object);
+			}
+
+			length = file_size - offset;
+			if (length <= 0)
+				continue;
+		}
+
+		/* The lookup above told us the object is small. */
+		if (file_size != -1 && file_size <= retr_info->SmallObjectSize)
+		{
+			retr_info->RangeOffset = offset;
+			retr_info->RangeLength = length;
+
+			result = retr_get_small_object(retr_info);
 			if (result)
 				break;
-
-			length = gfs_stat.size - offset;
-		
-			stat_destroy(&gfs_stat);
-			last_loop = 1;
+			continue;
 		}
 
 		/* This allows us to specify offset and length. */
@@ -273,55 +915,53 @@ retr_thread(void * UserArg)
 		                            retr_info->Object,
 		                            offset,
 		                            length,
-		                            &bulk_response);
+		                            retr_info->InOrder ? IN_ORDER : NONE,
+		                            &retr_info->BulkResponse);
 		if (result)
 			break;
 
-		for (i = 0; i < bulk_response->list_size; i++)
-		{
-			assert(bulk_response->list[i]->size == 1);
+		retr_info->RangeOffset = offset;
+		retr_info->RangeLength = length;
 
-/*
- * XXX bulk_response returns chunks that contain the offsets we need.
- * We must make one request per chunk that includes the ranges within
- * that chunk that we need.
- */
-			retr_info->Offset = bulk_response->list[i]->list[0].offset;
-			result = gds3_get_object_for_job(retr_info->Client,
-			                                 retr_info->Bucket,
-			                                 retr_info->Object,
-			                                 bulk_response->list[i]->list[0].offset,
-			                                 bulk_response->job_id->value,
-			                                 retr_ds3_callout,
-			                                 retr_info);
-			if (result)
-				break;
-		}
+		if (retr_info->BulkResponse->list_size)
+			result = retr_run_streams(retr_info, retr_info->MaxStreams);
+
+		ds3_free_bulk_response(retr_info->BulkResponse);
+		retr_info->BulkResponse = NULL;
+		free(retr_info->ChunkClaimed);
+		free(retr_info->ChunkAvailable);
+		retr_info->ChunkClaimed   = NULL;
+		retr_info->ChunkAvailable = NULL;
 
-		ds3_free_bulk_response(bulk_response);
-		bulk_response = NULL;
+		if (result)
+			break;
 	}
 
+	retr_wait_for_gridftp(retr_info);
+
+	if (!result)
+		result = retr_info->Result;
+
+	depth_log(&retr_info->Depth, "RETR", retr_info->TransferInfo->pathname);
+	aimd_log(&retr_info->Aimd, "RETR", retr_info->TransferInfo->pathname);
+
 	globus_gridftp_server_finished_transfer(retr_info->Operation, result);
-	ds3_free_bulk_response(bulk_response);
+	retr_destroy_info(retr_info);
 
 	return NULL;
 }
 
-
 void
 retr(ds3_client                 * Client, 
+     config_t                   * Config,
      globus_gfs_operation_t       Operation,
      globus_gfs_transfer_info_t * TransferInfo)
 {
-	globus_result_t result    = GLOBUS_SUCCESS;
-	retr_info_t   * retr_info = NULL;
-	char          * bucket    = NULL;
-	char          * object    = NULL;
-	int             rc        = 0;
-	int             initted   = 0;
-	pthread_t       thread;
-	pthread_attr_t  attr;
+	globus_result_t result       = GLOBUS_SUCCESS;
+	retr_info_t   * retr_info    = NULL;
+	char          * bucket       = NULL;
+	char          * object       = NULL;
+	int             opt_conn_cnt = 0;
 
 	GlobusGFSName(stor);
 
@@ -347,26 +987,51 @@ retr(ds3_client                 * Client,
 	memset(retr_info, 0, sizeof(retr_info_t));
 	pthread_mutex_init(&retr_info->Mutex, NULL);
 	pthread_cond_init(&retr_info->Cond, NULL);
+	governor_join(&retr_info->Share);
+	bufq_list_init(&retr_info->AllBuffers);
 	retr_info->Client       = Client;
 	retr_info->Operation    = Operation;
 	retr_info->TransferInfo = TransferInfo;
 	retr_info->Bucket       = bucket;
 	retr_info->Object       = object;
+	retr_info->MaxStreams   = Config->RetrStreams;
+	retr_info->SmallObjectSize = (globus_off_t)Config->SmallObjectSize * 1024;
 
 	globus_gridftp_server_get_block_size(Operation, &retr_info->BlockSize);
+	retr_info->BufferSize = pool_class_size(retr_info->BlockSize);
+	globus_gridftp_server_get_update_interval(Operation, &retr_info->MarkerFreq);
+	retr_info->LastMarker = time(NULL);
 
 	/*
-	 * Launch a detached thread.
+	 * Stream mode uses a single data connection and the server reports an
+	 * optimal concurrency of no more than two for it. Mode E with parallel
+	 * streams accepts writes at any offset; otherwise keep them in order.
 	 */
-	if ((rc = pthread_attr_init(&attr)) || !(initted = 1) ||
-	    (rc = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) ||
-	    (rc = pthread_create(&thread, &attr, retr_thread, retr_info)))
+	globus_gridftp_server_get_optimal_concurrency(Operation, &opt_conn_cnt);
+	retr_info->InOrder = (opt_conn_cnt <= 2);
+
+	/* Start from the server's suggestion; the controller takes it from there. */
+	depth_init(&retr_info->Depth, opt_conn_cnt);
+	aimd_init(&retr_info->Aimd, retr_info->MaxStreams);
+
+	retr_info->Streams = malloc(retr_info->MaxStreams * sizeof(retr_stream_t));
+	if (!retr_info->Streams)
 	{
-		result = GlobusGFSErrorSystemError("Launching get object thread", rc);
+		result = GlobusGFSErrorMemory("retr_stream_t");
 		globus_gridftp_server_finished_transfer(Operation, result);
 		retr_destroy_info(retr_info);
+		return;
 	}
 
-	if (initted) pthread_attr_destroy(&attr);
+	/*
+	 * Hand off to a worker.
+	 */
+	result = workers_submit(WORKERS_RETR, retr_thread, retr_info);
+	if (result)
+	{
+		result = GlobusGFSErrorWrapFailed("Launching get object thread", result);
+		globus_gridftp_server_finished_transfer(Operation, result);
+		retr_destroy_info(retr_info);
+	}
 }
 
@@ -46,19 +46,61 @@
  * System includes
  */
 #include <pthread.h>
+#include <time.h>
 
 /*
  * Globus includes
  */
 #include <globus_gridftp_server.h>
-#include <globus_list.h>
 
 /*
  * DS3 includes
  */
 #include <ds3.h>
 
+/*
+ * Local includes
+ */
+#include "config.h"
+#include "governor.h"
+#include "bufq.h"
+#include "depth.h"
+#include "aimd.h"
+
+/*
+ * Maximum number of full buffers we will hold, in stream mode, for chunks
+ * that are ahead of the next offset the client expects.
+ */
+#define RETR_REORDER_WINDOW 64
+
+struct retr_info;
+
 typedef struct {
+	char             * Buffer;
+	globus_off_t       Offset;
+	globus_size_t      Length;
+	struct retr_info * RetrInfo;
+	bufq_link_t        AllLink; // On AllBuffers
+	bufq_entry_t       Entry;   // On FreeBuffers or PendingBuffers
+} retr_buffer_t;
+
+/*
+ * One per concurrent chunk download. Each stream runs its own GET and
+ * fills its own buffer.
+ */
+typedef struct {
+	struct retr_info * RetrInfo;
+	pthread_t          Thread;
+	uint64_t           ChunkOffset; // Start of the range being retrieved
+	uint64_t           Offset;      // Next offset from DS3
+	uint64_t           EndOffset;   // End of the range being retrieved
+	struct timespec    Requested;   // When the GET went out, until its first byte
+
+	/* Buffer being filled from DS3; written once it holds BlockSize bytes. */
+	retr_buffer_t    * FillBuffer;
+} retr_stream_t;
+
+typedef struct retr_info {
 	globus_gfs_operation_t       Operation;
 	globus_gfs_transfer_info_t * TransferInfo;
 
@@ -68,22 +110,54 @@ typedef struct {
 
 	globus_result_t              Result;
 	globus_size_t                BlockSize;
+	globus_size_t                BufferSize; // BlockSize's pool size class; what the governor counts
 
 	pthread_mutex_t              Mutex;
 	pthread_cond_t               Cond;
 
-	uint64_t                     Offset;
+	/* The range of the file being sent and the job that covers it. */
+	globus_off_t                 RangeOffset;
+	globus_off_t                 RangeLength;
+	ds3_bulk_response          * BulkResponse;
+	int                          NextChunk;
+
+	/*
+	 * Out of order, streams take whichever chunks reach the cache first.
+	 * One stream at a time polls for newly available chunks.
+	 */
+	char                       * ChunkClaimed;
+	char                       * ChunkAvailable;
+	globus_bool_t                Polling;
+	int                          MarkerFreq;
+	time_t                       LastMarker;
+
+	retr_stream_t              * Streams;
+	int                          StreamCnt;
+	int                          MaxStreams;
+	globus_off_t                 SmallObjectSize; // Bytes; smaller objects skip the bulk job
+	aimd_t                       Aimd; // DS3 streams to run
+
+	/*
+	 * In stream mode the client must see offsets in order. Buffers ahead of
+	 * WriteOffset wait on PendingBuffers.
+	 */
+	globus_bool_t                InOrder;
+	globus_off_t                 WriteOffset;
+
+	depth_t Depth;    // Writes to keep in flight
+	int     WriteCnt; // Writes in flight
 
-	int OptConnCnt;
-	int ConnChkCnt;
+	governor_share_t Share;
 
-	globus_list_t * AllBufferList;
-	globus_list_t * FreeBufferList;
+	bufq_list_t  AllBuffers;
+	bufq_stack_t FreeBuffers;
+	bufq_table_t PendingBuffers; // Keyed by Offset
 
 } retr_info_t;
 
 void
 retr(ds3_client                 * Client, 
+     config_t                   * Config,
      globus_gfs_operation_t       Operation,
      globus_gfs_transfer_info_t * TransferInfo);
 
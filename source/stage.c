@@ -98,6 +98,7 @@ stage_get_timeout(globus_gfs_operation_t      Operation,
 
 globus_result_t
 stage_file(ds3_client           * Client,
+           catalog_t            * Catalog,
            char                 * Pathname, 
            int                    Timeout, 
            stage_file_residency * Residency)
@@ -119,7 +120,7 @@ stage_file(ds3_client           * Client,
 	*Residency = STAGE_FILE_RESIDENT;
 
 	// Make sure it is a regular file
-	result = stat_entry(Client, Pathname, &gstat);
+	result = stat_entry(Client, Catalog, Pathname, &gstat);
 	if (result)
 		return result;
 
@@ -133,6 +134,7 @@ stage_file(ds3_client           * Client,
 	                            object_name,
 	                            0,
 	                            gstat.size,
+	                            IN_ORDER,
 	                            &bulk_response);
 	if (result)
 		goto cleanup;
@@ -203,6 +205,7 @@ void
 stage(globus_gfs_operation_t      Operation,
       globus_gfs_command_info_t * CommandInfo,
       ds3_client                * Client,
+      catalog_t                 * Catalog,
       commands_callback           Callback)
 {
 	int                  timeout;
@@ -215,7 +218,7 @@ stage(globus_gfs_operation_t      Operation,
 	if (result)
 		goto cleanup;
 
-	result = stage_file(Client, CommandInfo->pathname, timeout, &residency);
+	result = stage_file(Client, Catalog, CommandInfo->pathname, timeout, &residency);
 	if (result)
 		goto cleanup;
 
@@ -62,6 +62,7 @@ void
 stage(globus_gfs_operation_t      Operation,
       globus_gfs_command_info_t * CommandInfo,
       ds3_client                * Client,
+      catalog_t                 * Catalog,
       commands_callback           Callback);
 
 #endif /* BLACKPEARL_DSI_STAGE_H */
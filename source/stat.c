@@ -42,6 +42,7 @@
 /*
  * System includes
  */
+#include <pthread.h>
 #include <libgen.h>
 #include <time.h>
 
@@ -56,6 +57,8 @@
 #include "stat.h"
 #include "path.h"
 #include "gds3.h"
+#include "catalog.h"
+#include "listing.h"
 
 globus_result_t
 stat_populate(char              * Name,
@@ -143,6 +146,257 @@ stat_get_link_count(ds3_client * Client,
 	return GLOBUS_SUCCESS;
 }
 
+/*
+ * A directory listing is fetched and parsed by its own thread, which turns
+ * entries into stat records as the DS3 response arrives and queues them
+ * for stat_entries(). The queue holds STAT_QUEUE_ENTRIES; when it is full
+ * the thread stops reading, so memory does not grow with the page size.
+ * Each page is requested as soon as the one before it has been read.
+ */
+struct stat_listing {
+	pthread_t          Thread;
+	pthread_mutex_t    Mutex;
+	pthread_cond_t     Cond;
+
+	ds3_client       * Client;
+	char             * BucketName;
+	char             * Prefix; // NULL at the top of the bucket
+	char             * Owner;  // For CommonPrefixes
+	listing_parser_t   Parser;
+
+	globus_gfs_stat_t  Queue[STAT_QUEUE_ENTRIES];
+	int                Head;
+	int                Count;
+	globus_result_t    Result;
+	int                Done;
+	int                Cancel;
+};
+
+/* Listing callback: queues the entry. Nonzero stops the listing. */
+static int
+stat_listing_add(listing_entry_t * Entry, void * Arg)
+{
+	stat_listing_t  * listing = Arg;
+	globus_result_t   result  = GLOBUS_SUCCESS;
+	globus_gfs_stat_t gfs_stat;
+	char            * name    = Entry->Key;
+	size_t            length  = 0;
+	int               stop    = 0;
+
+	/* The listing includes the object that marks the directory itself. */
+	if (listing->Prefix)
+	{
+		if (strcmp(name, listing->Prefix) == 0)
+			return 0;
+		name += strlen(listing->Prefix);
+	}
+
+	if (Entry->IsPrefix)
+	{
+		/* Directories are listed without their trailing '/'. */
+		length = strlen(name);
+		if (length && name[length - 1] == '/')
+			name[length - 1] = '\0';
+
+		result = stat_populate(name,
+		                       S_IFDIR,
+		                       2,
+		                       1024,
+		                       listing->Owner,
+		                       NULL,
+		                       &gfs_stat);
+	} else
+	{
+		result = stat_populate(name,
+		                       S_IFREG,
+		                       1,
+		                       Entry->Size,
+		                       Entry->Owner,
+		                       Entry->LastModified[0] ? Entry->LastModified : NULL,
+		                       &gfs_stat);
+	}
+
+	pthread_mutex_lock(&listing->Mutex);
+	{
+		if (result)
+		{
+			stat_destroy(&gfs_stat);
+			listing->Result = result;
+		} else
+		{
+			while (listing->Count == STAT_QUEUE_ENTRIES && !listing->Cancel)
+				pthread_cond_wait(&listing->Cond, &listing->Mutex);
+
+			if (listing->Cancel)
+			{
+				stat_destroy(&gfs_stat);
+			} else
+			{
+				listing->Queue[(listing->Head + listing->Count) % STAT_QUEUE_ENTRIES] = gfs_stat;
+				listing->Count++;
+				pthread_cond_broadcast(&listing->Cond);
+			}
+		}
+		stop = (listing->Result || listing->Cancel);
+	}
+	pthread_mutex_unlock(&listing->Mutex);
+
+	return stop;
+}
+
+static size_t
+stat_listing_callout(void * Buffer, size_t Size, size_t Count, void * Arg)
+{
+	stat_listing_t * listing = Arg;
+
+	if (listing_parser_feed(&listing->Parser, Buffer, Size * Count))
+		return 0;
+	return Size * Count;
+}
+
+static void *
+stat_listing_thread(void * Arg)
+{
+	stat_listing_t * listing = Arg;
+	globus_result_t  result  = GLOBUS_SUCCESS;
+	const char     * next    = NULL;
+	char           * marker  = NULL;
+	int              stop    = 0;
+
+	GlobusGFSName(stat_listing_thread);
+
+	do
+	{
+		listing_parser_init(&listing->Parser, stat_listing_add, listing);
+
+		result = gds3_stream_bucket(listing->Client,
+		                            listing->BucketName,
+		                            "/", /* Delimiter */
+		                            listing->Prefix,
+		                            marker,
+		                            STAT_PAGE_KEYS,
+		                            stat_listing_callout,
+		                            listing);
+
+		if (marker)
+			free(marker);
+		marker = NULL;
+
+		pthread_mutex_lock(&listing->Mutex);
+		{
+			/* We stopped the transfer; say why instead. */
+			if (listing->Result || listing->Cancel)
+			{
+				if (result)
+					globus_object_free(globus_error_get(result));
+				result = listing->Result;
+			} else if (!result && listing->Parser.Failed)
+			{
+				result = GlobusGFSErrorGeneric("Could not parse the bucket listing");
+			}
+			stop = (result || listing->Cancel);
+		}
+		pthread_mutex_unlock(&listing->Mutex);
+
+		if (!stop && (next = listing_parser_next_marker(&listing->Parser)))
+		{
+			marker = strdup(next);
+			if (!marker)
+				result = GlobusGFSErrorMemory("marker");
+		}
+	} while (marker);
+
+	pthread_mutex_lock(&listing->Mutex);
+	{
+		listing->Result = result;
+		listing->Done   = 1;
+		pthread_cond_broadcast(&listing->Cond);
+	}
+	pthread_mutex_unlock(&listing->Mutex);
+
+	return NULL;
+}
+
+static void
+stat_listing_free(stat_listing_t * Listing)
+{
+	if (Listing)
+	{
+		if (Listing->BucketName) free(Listing->BucketName);
+		if (Listing->Prefix)     free(Listing->Prefix);
+		if (Listing->Owner)      free(Listing->Owner);
+		pthread_mutex_destroy(&Listing->Mutex);
+		pthread_cond_destroy(&Listing->Cond);
+		free(Listing);
+	}
+}
+
+static globus_result_t
+stat_listing_start(ds3_client      * Client,
+                   stat_state_t    * State,
+                   stat_listing_t ** Listing)
+{
+	stat_listing_t * listing = NULL;
+	int              rc      = 0;
+
+	GlobusGFSName(stat_listing_start);
+
+	*Listing = NULL;
+
+	listing = calloc(1, sizeof(stat_listing_t));
+	if (!listing)
+		return GlobusGFSErrorMemory("stat_listing_t");
+
+	pthread_mutex_init(&listing->Mutex, NULL);
+	pthread_cond_init(&listing->Cond, NULL);
+	listing->Client     = Client;
+	listing->BucketName = strdup(State->_bucket_name);
+	listing->Owner      = strdup(ds3_str_value(State->_catalog->Response->owner->name));
+	if (State->_object_name)
+		listing->Prefix = strdup(State->_object_name);
+
+	if (!listing->BucketName || !listing->Owner || (State->_object_name && !listing->Prefix))
+	{
+		stat_listing_free(listing);
+		return GlobusGFSErrorMemory("stat_listing_t");
+	}
+
+	rc = pthread_create(&listing->Thread, NULL, stat_listing_thread, listing);
+	if (rc)
+	{
+		stat_listing_free(listing);
+		return GlobusGFSErrorSystemError("Launching listing thread", rc);
+	}
+
+	*Listing = listing;
+	return GLOBUS_SUCCESS;
+}
+
+/* Stops the listing thread, if it is still going, and frees the listing. */
+static void
+stat_listing_stop(stat_listing_t * Listing)
+{
+	if (!Listing)
+		return;
+
+	pthread_mutex_lock(&Listing->Mutex);
+	{
+		Listing->Cancel = 1;
+		pthread_cond_broadcast(&Listing->Cond);
+	}
+	pthread_mutex_unlock(&Listing->Mutex);
+
+	pthread_join(Listing->Thread, NULL);
+
+	if (Listing->Result)
+		globus_object_free(globus_error_get(Listing->Result));
+
+	for (; Listing->Count; Listing->Count--, Listing->Head++)
+		stat_destroy(&Listing->Queue[Listing->Head % STAT_QUEUE_ENTRIES]);
+
+	stat_listing_free(Listing);
+}
+
 void
 stat_init_state(stat_state_t * State)
 {
@@ -158,15 +412,30 @@ stat_is_complete(stat_state_t * State)
 void
 stat_destroy_state(stat_state_t * State)
 {
-	if (State->_service_response) ds3_free_service_response(State->_service_response);
-	if (State->_bucket_response)  ds3_free_bucket_response(State->_bucket_response);
+	stat_listing_stop(State->_listing);
+	if (State->_catalog)          catalog_release(State->_catalog);
 	if (State->_bucket_name)      free(State->_bucket_name);
 	if (State->_object_name)      free(State->_object_name);
-	if (State->_marker)           free(State->_marker);
+}
+
+/*
+ * Adds the newest entry to the reply's size. 1 = the reply should go out:
+ * it holds MaxEntries entries or, with a MaxBytes, about that many bytes.
+ */
+static int
+stat_reply_is_full(stat_state_t      * State,
+                   globus_gfs_stat_t * GFSStatArray,
+                   int                 Count,
+                   int                 MaxEntries,
+                   size_t              MaxBytes)
+{
+	State->_reply_bytes += STAT_ENTRY_BYTES + strlen(GFSStatArray[Count - 1].name);
+	return (Count == MaxEntries || (MaxBytes && State->_reply_bytes >= MaxBytes));
 }
 
 globus_result_t
 stat_entry(ds3_client        * Client,
+           catalog_t         * Catalog,
            char              * Path,
            globus_gfs_stat_t * GFSStat)
 {
@@ -175,37 +444,41 @@ stat_entry(ds3_client        * Client,
 	globus_result_t result;
 
 	stat_init_state(&state);
-	result = stat_entries(Client, Path, 1, 1, GFSStat, &count_out, &state);
+	result = stat_entries(Client, Catalog, Path, 1, 1, 0, GFSStat, &count_out, &state);
 	stat_destroy_state(&state);
 	return result;
 }
 
 globus_result_t
 stat_entries(ds3_client        * Client,
+             catalog_t         * Catalog,
              char              * Path,
              int                 FileOnly,
              int                 MaxEntries,
+             size_t              MaxBytes,
              globus_gfs_stat_t * GFSStatArray,
              int               * CountOut,
              stat_state_t      * State)
 {
-	globus_result_t result = GLOBUS_SUCCESS;
+	globus_result_t  result  = GLOBUS_SUCCESS;
+	stat_listing_t * listing = NULL;
 	int i = 0;
-	int expanding_search = 0;
 
 	GlobusGFSName(stat_entries);
 
 	if (!State->_bucket_name && !State->_object_name)
 		path_split(Path, &State->_bucket_name, &State->_object_name);
 
-	if (!State->_service_response)
+	/* Held until the state is destroyed so a listing of '/' sees one list. */
+	if (!State->_catalog)
 	{
-		result = gds3_get_service(Client, &State->_service_response);
+		result = catalog_get(Catalog, Client, &State->_catalog);
 		if (result != GLOBUS_SUCCESS)
 			return result;
 	}
 
 	*CountOut = 0;
+	State->_reply_bytes = 0;
 
 	/* No bucket_name means it _is_ '/' */
 	if (!State->_bucket_name)
@@ -215,9 +488,9 @@ stat_entries(ds3_client        * Client,
 			/* Return a stat of only '/'. */
 			result = stat_populate("/",
 			                       S_IFDIR,
-			                       State->_service_response->num_buckets + 2,
+			                       State->_catalog->Response->num_buckets + 2,
 			                       1024,
-			                       ds3_str_value(State->_service_response->owner->name),
+			                       ds3_str_value(State->_catalog->Response->owner->name),
 			                       NULL,
 			                       &GFSStatArray[(*CountOut)++]);
 			State->_complete = 1;
@@ -225,52 +498,54 @@ stat_entries(ds3_client        * Client,
 		} else
 		{
 			/* Return the contents of '/'. */
-			if (State->_index++ == 0)
+			if (State->_index == 0)
 			{
+				State->_index++;
 				result = stat_populate(".",
 				                       S_IFDIR,
-				                       State->_service_response->num_buckets + 2,
+				                       State->_catalog->Response->num_buckets + 2,
 				                       1024,
-				                       ds3_str_value(State->_service_response->owner->name),
+				                       ds3_str_value(State->_catalog->Response->owner->name),
 				                       NULL, // XXX no modify time
 				                       &GFSStatArray[(*CountOut)++]);
 
-				if (result != GLOBUS_SUCCESS || *CountOut == MaxEntries)
+				if (result != GLOBUS_SUCCESS || stat_reply_is_full(State, GFSStatArray, *CountOut, MaxEntries, MaxBytes))
 					return result;
 			}
 
-			if (State->_index++ == 1)
+			if (State->_index == 1)
 			{
+				State->_index++;
 				result = stat_populate("..",
 				                       S_IFDIR,
-				                       State->_service_response->num_buckets + 2,
+				                       State->_catalog->Response->num_buckets + 2,
 				                       1024,
-				                       ds3_str_value(State->_service_response->owner->name),
+				                       ds3_str_value(State->_catalog->Response->owner->name),
 				                       NULL, // XXX no modify time
 				                       &GFSStatArray[(*CountOut)++]);
 
-				if (State->_service_response->num_buckets == 0)
+				if (State->_catalog->Response->num_buckets == 0)
 					State->_complete = 1;
 
-				if (result != GLOBUS_SUCCESS || *CountOut == MaxEntries)
+				if (result != GLOBUS_SUCCESS || stat_reply_is_full(State, GFSStatArray, *CountOut, MaxEntries, MaxBytes))
 					return result;
 			}
 
-			for (i = State->_index-2;
-			     i < State->_service_response->num_buckets && *CountOut < MaxEntries;
-			     i++)
+			/* _index counts '.' and '..' too. */
+			for (i = State->_index - 2; i < State->_catalog->Response->num_buckets; i++)
 			{
-				result = stat_populate(ds3_str_value(State->_service_response->buckets[i].name),
+				State->_index++;
+				result = stat_populate(ds3_str_value(State->_catalog->Response->buckets[i].name),
 				                       S_IFDIR,
 				                       2,
 				                       1024,
-				                       ds3_str_value(State->_service_response->owner->name),
-				                       ds3_str_value(State->_service_response->buckets[i].creation_date),
+				                       ds3_str_value(State->_catalog->Response->owner->name),
+				                       ds3_str_value(State->_catalog->Response->buckets[i].creation_date),
 				                       &GFSStatArray[(*CountOut)++]);
-				if (result != GLOBUS_SUCCESS)
-					return result;
+				if (result != GLOBUS_SUCCESS || stat_reply_is_full(State, GFSStatArray, *CountOut, MaxEntries, MaxBytes))
+					break;
 			}
-			State->_complete = (i == State->_service_response->num_buckets);
+			State->_complete = (State->_index - 2 == State->_catalog->Response->num_buckets);
 			return result;
 		}
 	}
@@ -278,204 +553,152 @@ stat_entries(ds3_client        * Client,
 	/* No object_name means it is _in_ '/' */
 	if (!State->_object_name && FileOnly)
 	{
-		for (i = 0;
-		     i < State->_service_response->num_buckets;
-		     i++)
-		{
-			if (strcmp(State->_bucket_name, ds3_str_value(State->_service_response->buckets[i].name)) == 0)
-			{
-				result = stat_populate(ds3_str_value(State->_service_response->buckets[i].name),
-				                       S_IFDIR,
-				                       2,
-				                       1024,
-				                       ds3_str_value(State->_service_response->owner->name),
-				                       ds3_str_value(State->_service_response->buckets[i].creation_date),
-				                       &GFSStatArray[(*CountOut)++]);
-				State->_complete = 1;
-				return result;
-			}
-		}
+		ds3_bucket * bucket = catalog_find_bucket(State->_catalog, State->_bucket_name);
+
+		if (!bucket)
+			return GlobusGFSErrorGeneric("No such file or directory");
 
-		return GlobusGFSErrorGeneric("No such file or directory");
+		result = stat_populate(ds3_str_value(bucket->name),
+		                       S_IFDIR,
+		                       2,
+		                       1024,
+		                       ds3_str_value(State->_catalog->Response->owner->name),
+		                       ds3_str_value(bucket->creation_date),
+		                       &GFSStatArray[(*CountOut)++]);
+		State->_complete = 1;
+		return result;
 	}
 
-	/* Let's find this object. */
+	/*
+	 * Let's find this object. An exact-name lookup answers most stats in one
+	 * request; only when there is no such object do we probe for a
+	 * directory of that name.
+	 */
 	if (State->_object_name && State->_object_name[strlen(State->_object_name)-1] != '/')
 	{
-		do
-		{
-			/* Get the next response. */
-			if (!State->_bucket_response)
-			{
-				result = gds3_get_bucket(Client,
-				                         State->_bucket_name,
-				                         &State->_bucket_response,
-				                         "/", /* Delimiter */
-				                         State->_object_name,
-				                         State->_marker,
-				                         MaxEntries);
-				if (result)
-					return result;
-			}
+		ds3_object * object       = NULL;
+		int          is_directory = 0;
 
-			/* If it is an object... */
-			for (i = 0; i < State->_bucket_response->num_objects; i++)
-			{
-				if (strcmp(State->_object_name, ds3_str_value(State->_bucket_response->objects[i].name)) == 0)
-				{
-					char * last_modified = NULL;
-					if (State->_bucket_response->objects[i].last_modified)
-						last_modified = ds3_str_value(State->_bucket_response->objects[i].last_modified);
-					result = stat_populate(basename(State->_object_name),
-					                       S_IFREG,
-					                       1,
-					                       State->_bucket_response->objects[i].size,
-					                       ds3_str_value(State->_bucket_response->objects[i].owner->name),
-					                       last_modified,
-					                       &GFSStatArray[(*CountOut)++]);
-					State->_complete = 1;
-					return result;
-				}
-			}
+		result = gds3_get_object(Client, State->_bucket_name, State->_object_name, &object);
+		if (result)
+			return result;
 
-			/* If it is a directory... */
-			for (i = 0; i < State->_bucket_response->num_common_prefixes; i++)
-			{
-				if (strncmp(State->_object_name,
-				            ds3_str_value(State->_bucket_response->common_prefixes[i]),
-				            ds3_str_size(State->_bucket_response->common_prefixes[i])-1) == 0 &&
-				    State->_bucket_response->common_prefixes[i]->value[
-				                      State->_bucket_response->common_prefixes[i]->size-1] == '/')
-				{
-					/* If we do not need to expand the directory... */
-					if (FileOnly)
-					{
-						result = stat_populate(basename(State->_object_name),
-						                       S_IFDIR,
-						                       2,
-						                       1024,
-						                       ds3_str_value(State->_service_response->owner->name),
-						                       NULL,
-						                       &GFSStatArray[(*CountOut)++]);
-						State->_complete = 1;
-						return result;
-					} else
-					{
-						char * new_object_name = malloc(strlen(State->_object_name)+2);
-						sprintf(new_object_name, "%s/", State->_object_name);
-						free(State->_object_name);
-						State->_object_name = new_object_name;
-
-						if (State->_bucket_response)
-							ds3_free_bucket_response(State->_bucket_response);
-						State->_bucket_response = NULL;
-						if (State->_marker)
-							free(State->_marker);
-						State->_index = 0;
-
-						expanding_search = 1;
-						break;
-					}
-				}
-			}
-		} while (State->_marker);
+		/* If it is an object... */
+		if (object)
+		{
+			char * last_modified = NULL;
+			if (object->last_modified)
+				last_modified = ds3_str_value(object->last_modified);
+			result = stat_populate(basename(State->_object_name),
+			                       S_IFREG,
+			                       1,
+			                       object->size,
+			                       ds3_str_value(State->_catalog->Response->owner->name),
+			                       last_modified,
+			                       &GFSStatArray[(*CountOut)++]);
+			gds3_free_object(object);
+			State->_complete = 1;
+			return result;
+		}
+
+		result = gds3_is_directory(Client, State->_bucket_name, State->_object_name, &is_directory);
+		if (result)
+			return result;
 
 		/* We could not find it. */
-		if (!expanding_search)
+		if (!is_directory)
 			return GlobusGFSErrorGeneric("No such file or directory");
-	}
 
-	do
-	{
-		/* First pass. */
-		if (!State->_bucket_response && !State->_index)
+		/* If we do not need to expand the directory... */
+		if (FileOnly)
 		{
-			result = stat_populate(".",
+			result = stat_populate(basename(State->_object_name),
 			                       S_IFDIR,
 			                       2,
 			                       1024,
-			                       ds3_str_value(State->_service_response->owner->name),
-			                       NULL, // XXX no modify time
+			                       ds3_str_value(State->_catalog->Response->owner->name),
+			                       NULL,
 			                       &GFSStatArray[(*CountOut)++]);
+			State->_complete = 1;
+			return result;
+		}
 
-			if (result != GLOBUS_SUCCESS)
-				return result;
+		char * new_object_name = malloc(strlen(State->_object_name)+2);
+		if (!new_object_name)
+			return GlobusGFSErrorMemory("object name");
+		sprintf(new_object_name, "%s/", State->_object_name);
+		free(State->_object_name);
+		State->_object_name = new_object_name;
+		State->_index = 0;
+	}
 
-			result = stat_populate("..",
-			                       S_IFDIR,
-			                       2,
-			                       1024,
-			                       ds3_str_value(State->_service_response->owner->name),
-			                       NULL, // XXX no modify time
-			                       &GFSStatArray[(*CountOut)++]);
+	/* First passes; a full reply ends the call and the next one picks up here. */
+	if (State->_index == 0)
+	{
+		State->_index++;
+		result = stat_populate(".",
+		                       S_IFDIR,
+		                       2,
+		                       1024,
+		                       ds3_str_value(State->_catalog->Response->owner->name),
+		                       NULL, // XXX no modify time
+		                       &GFSStatArray[(*CountOut)++]);
+
+		if (result != GLOBUS_SUCCESS || stat_reply_is_full(State, GFSStatArray, *CountOut, MaxEntries, MaxBytes))
+			return result;
+	}
 
-			if (result != GLOBUS_SUCCESS)
-				return result;
-		}
+	if (State->_index == 1)
+	{
+		State->_index++;
+		result = stat_populate("..",
+		                       S_IFDIR,
+		                       2,
+		                       1024,
+		                       ds3_str_value(State->_catalog->Response->owner->name),
+		                       NULL, // XXX no modify time
+		                       &GFSStatArray[(*CountOut)++]);
+
+		if (result != GLOBUS_SUCCESS || stat_reply_is_full(State, GFSStatArray, *CountOut, MaxEntries, MaxBytes))
+			return result;
+	}
 
-		/* Get the next response. */
-		if (!State->_bucket_response)
-		{
-			result = gds3_get_bucket(Client,
-			                         State->_bucket_name,
-			                         &State->_bucket_response,
-			                         "/", /* Delimiter */
-			                         State->_object_name,
-			                         State->_marker,
-			                         MaxEntries);
-			if (result)
-				return result;
-
-			State->_index = 0;
-		}
+	if (!State->_listing)
+	{
+		result = stat_listing_start(Client, State, &State->_listing);
+		if (result != GLOBUS_SUCCESS)
+			return result;
+	}
 
-		for (i = State->_index; i < State->_bucket_response->num_objects; i++, State->_index++)
+	/* Take entries until the reply is full or the listing ends. */
+	listing = State->_listing;
+	pthread_mutex_lock(&listing->Mutex);
+	{
+		while (1)
 		{
-			if (State->_object_name && strcmp(State->_bucket_response->objects[i].name->value, State->_object_name) == 0)
-				continue;
+			while (listing->Count == 0 && !listing->Done)
+				pthread_cond_wait(&listing->Cond, &listing->Mutex);
 
-			char * last_modified = NULL;
-			if (State->_bucket_response->objects[i].last_modified)
-				last_modified = ds3_str_value(State->_bucket_response->objects[i].last_modified);
-			result = stat_populate(State->_bucket_response->objects[i].name->value + (State->_object_name ? strlen(State->_object_name) : 0),
-			                       S_IFREG,
-			                       1,
-			                       State->_bucket_response->objects[i].size,
-			                       ds3_str_value(State->_bucket_response->objects[i].owner->name),
-			                       last_modified,
-			                       &GFSStatArray[(*CountOut)++]);
+			if (listing->Count == 0)
+			{
+				/* Hand the error to our caller; stat_listing_stop() must not free it. */
+				result = listing->Result;
+				listing->Result  = GLOBUS_SUCCESS;
+				State->_complete = 1;
+				break;
+			}
 
-			if (result != GLOBUS_SUCCESS || *CountOut == MaxEntries)
-				return result;
-		}
+			GFSStatArray[(*CountOut)++] = listing->Queue[listing->Head];
+			listing->Head = (listing->Head + 1) % STAT_QUEUE_ENTRIES;
+			listing->Count--;
+			pthread_cond_broadcast(&listing->Cond);
 
-		for (i = State->_index - State->_bucket_response->num_objects;
-		     i < State->_bucket_response->num_common_prefixes; 
-		     i++, State->_index++)
-		{
-			char * entry = malloc(State->_bucket_response->common_prefixes[i]->size);
-			snprintf(entry,
-			         State->_bucket_response->common_prefixes[i]->size, 
-			         "%s", 
-			         State->_bucket_response->common_prefixes[i]->value);
-			result = stat_populate(entry + (State->_object_name ? strlen(State->_object_name) : 0),
-			                       S_IFDIR,
-			                       2,
-			                       1024,
-			                       ds3_str_value(State->_service_response->owner->name),
-			                       NULL,
-			                       &GFSStatArray[(*CountOut)++]);
-			free(entry);
-			if (result != GLOBUS_SUCCESS || *CountOut == MaxEntries)
-				return result;
+			if (stat_reply_is_full(State, GFSStatArray, *CountOut, MaxEntries, MaxBytes))
+				break;
 		}
+	}
+	pthread_mutex_unlock(&listing->Mutex);
 
-		ds3_free_bucket_response(State->_bucket_response);
-		State->_bucket_response = NULL;
-
-	} while (State->_marker);
-
-	State->_complete = 1;
 	return result;
 }
 
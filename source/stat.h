@@ -51,14 +51,31 @@
  */
 #include <ds3.h>
 
+/*
+ * Local includes
+ */
+#include "catalog.h"
+
+/*
+ * Keys per DS3 listing page; the most the BlackPearl returns. Replies to
+ * the client are sized separately by MaxEntries and MaxBytes.
+ */
+#define STAT_PAGE_KEYS   1000
+/* Parsed entries a listing may hold ahead of the replies. */
+#define STAT_QUEUE_ENTRIES 1024
+/* Rough bytes a listing entry takes in a reply, not counting its name. */
+#define STAT_ENTRY_BYTES 96
+
+typedef struct stat_listing stat_listing_t;
+
 typedef struct {
-	ds3_get_service_response * _service_response;
-	ds3_get_bucket_response  * _bucket_response;
+	catalog_snapshot_t       * _catalog;
+	stat_listing_t           * _listing;
 	char                     * _bucket_name;
 	char                     * _object_name;
-	char                     * _marker;
 	int                        _index;
 	int                        _complete;
+	size_t                     _reply_bytes;
 } stat_state_t;
 
 void
@@ -72,14 +89,17 @@ stat_destroy_state(stat_state_t * StatState);
 
 globus_result_t
 stat_entry(ds3_client        * Client,
+           catalog_t         * Catalog,
            char              * Path,
            globus_gfs_stat_t * GFSStat);
 
 globus_result_t
 stat_entries(ds3_client        * Client,
+             catalog_t         * Catalog,
              char              * Path,
              int                 FileOnly,
              int                 MaxEntries,
+             size_t              MaxBytes,   // 0 = no limit
              globus_gfs_stat_t * GFSStatArray,
              int               * CountOut,
              stat_state_t      * State);
@@ -42,8 +42,12 @@
 /*
  * System includes
  */
+#include <sys/select.h>
 #include <pthread.h>
 #include <assert.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
 
 /*
  * Globus includes
@@ -62,6 +66,26 @@
 #include "gds3.h"
 #include "path.h"
 #include "markers.h"
+#include "pool.h"
+#include "governor.h"
+#include "workers.h"
+#include "gds3_async.h"
+#include "error.h"
+#include "mdcache.h"
+
+/* Called locked. 1 = a stream is blocked waiting for Offset. */
+static int
+stor_stream_waiting_for(stor_info_t * StorInfo, uint64_t Offset)
+{
+	int i = 0;
+
+	for (i = 0; i < StorInfo->StreamCnt; i++)
+	{
+		if (StorInfo->Streams[i].Blocked && StorInfo->Streams[i].Offset == Offset)
+			return 1;
+	}
+	return 0;
+}
 
 void
 stor_gridftp_callout(globus_gfs_operation_t Operation,
@@ -85,50 +109,72 @@ stor_gridftp_callout(globus_gfs_operation_t Operation,
 		/* Save any error */
 		if (Result && !stor_info->Result) stor_info->Result = Result;
 
-//		// Make sure things are coming in in order
-//		if (!stor_info->Result && Length != 0 && Offset != stor_info->GridFTPOffset)
-
 		/* Set buffer counters. */
 		stor_buffer->BufferOffset   = 0;
 		stor_buffer->TransferOffset = Offset;
 		stor_buffer->BufferLength   = Length;
 
-		/* Stor the buffer. */
+		/*
+		 * Stor the buffer. With parallel data channels, buffers arrive in
+		 * any order; they wait on the ready list, indexed by TransferOffset,
+		 * until the DS3 thread reaches their offset.
+		 */
 		if (Length)
-			globus_list_insert(&stor_info->ReadyBufferList, stor_buffer);
+			bufq_table_insert(&stor_info->ReadyBuffers, &stor_buffer->Entry, Offset);
 		else
-			globus_list_insert(&stor_info->FreeBufferList, stor_buffer);
+			bufq_stack_push(&stor_info->FreeBuffers, &stor_buffer->Entry);
 
 		/* Decrease the current connection count. */
 		stor_info->CurConnCnt--;
-
-//		// Move our offset forward
-//		stor_info->GridFTPOffset += Length;
-
-		/* Wake the DS3 thread */
-		pthread_cond_signal(&stor_info->Cond);
+		depth_filled(&stor_info->Depth, Length);
+
+		/*
+		 * Wake the DS3 streams if one of them is waiting for this offset.
+		 * Otherwise, let reads finish in batches of half the concurrency
+		 * before waking them to launch more.
+		 */
+		if (Eof || stor_info->Result ||
+		    stor_info->CurConnCnt <= stor_info->Depth.Target / 2 ||
+		    (Length && stor_stream_waiting_for(stor_info, Offset)))
+			pthread_cond_broadcast(&stor_info->Cond);
 	}
 	pthread_mutex_unlock(&stor_info->Mutex);
 }
 
-/* 1 = found, 0 = not found */
-int
-stor_find_buffer(void * Datum, void * Arg)
+/*
+ * Called locked. Returns an empty buffer to the free list or, if this
+ * transfer holds more than its share of the buffer budget or more than its
+ * target depth needs, to the pool.
+ */
+static void
+stor_release_buffer(stor_info_t * StorInfo, stor_buffer_t * StorBuffer)
 {
-	if (((stor_buffer_t *)Datum)->TransferOffset == *((uint64_t *)Arg))
-		return 1;
+	if (StorInfo->AllBuffers.Count <= StorInfo->Depth.Target + StorInfo->ReadyBuffers.Count &&
+	    !governor_over_share(&StorInfo->Share))
+	{
+		bufq_stack_push(&StorInfo->FreeBuffers, &StorBuffer->Entry);
+		return;
+	}
 
-	return 0;
+	bufq_list_remove(&StorInfo->AllBuffers, &StorBuffer->AllLink);
+
+	pool_put(StorBuffer->Buffer, StorInfo->BlockSize);
+	governor_release(&StorInfo->Share, StorInfo->BufferSize);
+	free(StorBuffer);
 }
 
-/* Called locked. */
+/*
+ * Called locked. The lock is dropped around each copy; the buffer is off the
+ * ready table while we copy from it, so no other stream can reach it.
+ * CopyCnt tells those streams the data is still coming.
+ */
 uint64_t
 stor_copy_out_buffers(stor_info_t * StorInfo,
                       void        * Buffer,
                       uint64_t      Offset,
                       uint64_t      Length)
- {
-	globus_list_t * buf_entry      = NULL;
+{
+	bufq_entry_t  * buf_entry      = NULL;
 	stor_buffer_t * stor_buffer    = NULL;
 	uint64_t        offset_needed  = 0;
 	uint64_t        copied_length  = 0;
@@ -139,37 +185,50 @@ stor_copy_out_buffers(stor_info_t * StorInfo,
 		offset_needed = Offset + copied_length;
 
 		/* Look for a buffer containing this offset. */
-		buf_entry = globus_list_search_pred(StorInfo->ReadyBufferList,
-		                                    stor_find_buffer,
-		                                    &offset_needed);
+		buf_entry = bufq_table_remove(&StorInfo->ReadyBuffers, offset_needed);
 
 		if (buf_entry)
 		{
-			stor_buffer = globus_list_first(buf_entry);
+			stor_buffer = bufq_container(buf_entry, stor_buffer_t, Entry);
 
 			/* Set length to copy to size of our GridFTP buffer. */
 			length_to_copy = stor_buffer->BufferLength;
 
-			/* Limit to length that DS3 is asking for. */
-			if (length_to_copy > Length)
-				length_to_copy = Length;
+			/* Limit to length that DS3 is still asking for. */
+			if (length_to_copy > Length - copied_length)
+				length_to_copy = Length - copied_length;
 
+			StorInfo->CopyCnt++;
+			pthread_mutex_unlock(&StorInfo->Mutex);
 			memcpy(Buffer + copied_length,
 			       stor_buffer->Buffer + stor_buffer->BufferOffset, 
 			       length_to_copy);
+			pthread_mutex_lock(&StorInfo->Mutex);
 
 			/* Update buffer counters. */
 			stor_buffer->BufferOffset   += length_to_copy;
 			stor_buffer->TransferOffset += length_to_copy;
 			stor_buffer->BufferLength   -= length_to_copy;
 			copied_length               += length_to_copy;
+			depth_drained(&StorInfo->Depth, length_to_copy);
 
-			/* If empty, move it to free. */
+			/* If empty, move it to free. Otherwise, file it under its new offset. */
 			if (stor_buffer->BufferLength == 0)
+				stor_release_buffer(StorInfo, stor_buffer);
+			else
 			{
-				globus_list_remove(&StorInfo->ReadyBufferList, buf_entry);
-				globus_list_insert(&StorInfo->FreeBufferList,  stor_buffer);
+				bufq_table_insert(&StorInfo->ReadyBuffers,
+				                  &stor_buffer->Entry,
+				                  stor_buffer->TransferOffset);
+
+				/* The rest may start the next stream's chunk. */
+				if (stor_stream_waiting_for(StorInfo, stor_buffer->TransferOffset))
+					pthread_cond_broadcast(&StorInfo->Cond);
 			}
+
+			/* Streams that hit Eof wait for copies in progress. */
+			if (--StorInfo->CopyCnt == 0)
+				pthread_cond_broadcast(&StorInfo->Cond);
 		}
 	} while (copied_length != Length && buf_entry);
 
@@ -182,24 +241,40 @@ stor_launch_gridftp_reads(stor_info_t * StorInfo)
 {
 	stor_buffer_t * stor_buffer = NULL;
 	globus_result_t result      = GLOBUS_SUCCESS;
+	int             reorder_cnt = 0;
 
 	GlobusGFSName(stor_launch_gridftp_reads);
 
-	if (StorInfo->ConnChkCnt++ == 0)
-		globus_gridftp_server_get_optimal_concurrency(StorInfo->Operation,
-		                                             &StorInfo->OptConnCnt);
-	if (StorInfo->ConnChkCnt >= 100) StorInfo->ConnChkCnt = 0;
+	/*
+	 * Buffers parked on the ready list waiting for an earlier offset do not
+	 * count against our reads in flight. Let the buffer count grow past the
+	 * target depth by the number of ready buffers, up to the reorder window,
+	 * so the stream carrying the missing offset can still be read.
+	 */
+	reorder_cnt = StorInfo->ReadyBuffers.Count;
+	if (reorder_cnt > STOR_REORDER_WINDOW)
+		reorder_cnt = STOR_REORDER_WINDOW;
 
-	// This code assumes the buffers are coming in in order.
-	while (StorInfo->CurConnCnt < StorInfo->OptConnCnt)
+	while (StorInfo->CurConnCnt < StorInfo->Depth.Target)
 	{
-		if (!globus_list_empty(StorInfo->FreeBufferList))
+		if (StorInfo->FreeBuffers.Count)
 		{
 			/* Grab a buffer from the free list. */
-			stor_buffer = globus_list_remove(&StorInfo->FreeBufferList,
-			                                  StorInfo->FreeBufferList);
-		} else if (globus_list_size(StorInfo->AllBufferList) >= StorInfo->OptConnCnt)
+			stor_buffer = bufq_container(bufq_stack_pop(&StorInfo->FreeBuffers),
+			                             stor_buffer_t,
+			                             Entry);
+		} else if (StorInfo->AllBuffers.Count >= StorInfo->Depth.Target + reorder_cnt)
+		{
+			break;
+		} else if (!governor_reserve(&StorInfo->Share,
+		                             StorInfo->BufferSize,
+		                             StorInfo->AllBuffers.Count <= StorInfo->ReadyBuffers.Count))
 		{
+			/*
+			 * Over budget. Wait for our reads in flight to come back; if every
+			 * buffer we have is parked on the ready list, the governor lets
+			 * us have one more so the missing offset can still arrive.
+			 */
 			break;
 		} else
 		{
@@ -207,18 +282,19 @@ stor_launch_gridftp_reads(stor_info_t * StorInfo)
 			stor_buffer = globus_malloc(sizeof(stor_buffer_t));
 			if (!stor_buffer)
 			{
+				governor_release(&StorInfo->Share, StorInfo->BufferSize);
 				result = GlobusGFSErrorMemory("stor_buffer_t");
 				break;
 			}
-			stor_buffer->Buffer = globus_malloc(StorInfo->BlockSize);
-			if (!stor_buffer->Buffer)
+			result = pool_get(StorInfo->BlockSize, &stor_buffer->Buffer);
+			if (result)
 			{
+				governor_release(&StorInfo->Share, StorInfo->BufferSize);
 				free(stor_buffer);
-				result = GlobusGFSErrorMemory("stor_buffer_t");
 				break;
 			}
 			stor_buffer->StorInfo = StorInfo;
-			globus_list_insert(&StorInfo->AllBufferList, stor_buffer);
+			bufq_list_insert(&StorInfo->AllBuffers, &stor_buffer->AllLink);
 		}
 
 		result = globus_gridftp_server_register_read(StorInfo->Operation,
@@ -237,20 +313,39 @@ stor_launch_gridftp_reads(stor_info_t * StorInfo)
 	return result;
 }
 
+/*
+ * Called locked, after stor_launch_gridftp_reads(). If no reads are in
+ * flight and no stream can find its next offset on the ready list, every
+ * buffer is parked waiting for data that can not arrive.
+ */
 globus_result_t
-stor_check_for_parallel_conns(stor_info_t * StorInfo, uint64_t Offset)
+stor_check_reorder_window(stor_info_t * StorInfo, stor_stream_t * StorStream)
 {
-	GlobusGFSName(stor_check_for_parallel_conns);
-	if (globus_list_size(StorInfo->ReadyBufferList) > 0)
+	stor_stream_t * stor_stream = NULL;
+	int             i           = 0;
+
+	GlobusGFSName(stor_check_reorder_window);
+
+	if (StorInfo->CurConnCnt > 0)
+		return GLOBUS_SUCCESS;
+
+	for (i = 0; i < StorInfo->StreamCnt; i++)
 	{
-		if (globus_list_search_pred(StorInfo->ReadyBufferList,
-		                            stor_find_buffer,
-		                            &Offset) == NULL)
-		{
-			return GlobusGFSErrorGeneric("Out of order buffer offsets detected. Please disable parallel data channels.");
-		}
+		stor_stream = &StorInfo->Streams[i];
+
+		if (!stor_stream->Active)
+			continue;
+
+		/* Another stream is running; it may yet release buffers. */
+		if (stor_stream != StorStream && !stor_stream->Blocked)
+			return GLOBUS_SUCCESS;
+
+		if (bufq_table_find(&StorInfo->ReadyBuffers, stor_stream->Offset) != NULL)
+			return GLOBUS_SUCCESS;
 	}
-	return GLOBUS_SUCCESS;
+
+	return GlobusGFSErrorGeneric("Out of order data exceeds the reorder window. "
+	                             "Please reduce the number of parallel data channels.");
 }
 
 size_t
@@ -260,48 +355,95 @@ stor_ds3_callout(void * Buffer,
                  void * UserArg)
 {
 	uint64_t        copied_length = 0;
-	stor_info_t   * stor_info     = UserArg;
+	uint64_t        start_offset  = 0;
+	stor_stream_t * stor_stream   = UserArg;
+	stor_info_t   * stor_info     = stor_stream->StorInfo;
 	globus_result_t result        = GLOBUS_SUCCESS;
+	uint64_t        length        = 0;
 
 	GlobusGFSName(stor_ds3_callout);
 
 	pthread_mutex_lock(&stor_info->Mutex);
 	{
+		start_offset = stor_stream->Offset;
+
 		while (!result && copied_length != Length*Nmemb && !stor_info->Result)
 		{
-			copied_length += stor_copy_out_buffers(stor_info,
-			                                       Buffer + copied_length, 
-			                                       stor_info->DS3Offset + copied_length,
-			                                       Length*Nmemb - copied_length);
+			length = stor_copy_out_buffers(stor_info,
+			                               Buffer + copied_length, 
+			                               stor_stream->Offset,
+			                               Length*Nmemb - copied_length);
+			copied_length       += length;
+			stor_stream->Offset += length;
+
+			/*
+			 * Hand emptied buffers straight back to the data channels rather
+			 * than waiting until we run dry, so GridFTP keeps reading while
+			 * DS3 drains what we already hold.
+			 */
+			if (length && !stor_info->Eof && stor_info->FreeBuffers.Count)
+			{
+				result = stor_launch_gridftp_reads(stor_info);
+				if (result)
+					break;
+			}
+
+			if (copied_length == Length*Nmemb)
+				break;
 
 			if (stor_info->Eof)
 			{
-				if (copied_length != Length*Nmemb && (copied_length + stor_info->DS3Offset) != stor_info->TransferInfo->alloc_size)
-					result = GlobusGFSErrorGeneric("Premature end of data transfer");
-				break;
-			}
+				/*
+				 * Other data channels may still be delivering earlier
+				 * offsets, and another stream may be copying a buffer that
+				 * runs into ours.
+				 */
+				if (stor_info->CurConnCnt == 0 && stor_info->CopyCnt == 0)
+				{
+					if (stor_stream->Offset != stor_info->TransferInfo->alloc_size)
+						result = GlobusGFSErrorGeneric("Premature end of data transfer");
+					break;
+				}
+			} else
+			{
+				result = stor_launch_gridftp_reads(stor_info);
 
-			result = stor_check_for_parallel_conns(stor_info,
-			                                       stor_info->DS3Offset + copied_length);
+				if (!result)
+					result = stor_check_reorder_window(stor_info, stor_stream);
+			}
 
 			if (!result)
-				result = stor_launch_gridftp_reads(stor_info);
+			{
+				/* DS3 is waiting on the data channels. */
+				if (!stor_info->Eof)
+					depth_stalled(&stor_info->Depth,
+					              governor_over_share(&stor_info->Share));
 
-			if (!result && copied_length != Length*Nmemb)
+				stor_stream->Blocked = 1;
 				pthread_cond_wait(&stor_info->Cond, &stor_info->Mutex);
+				stor_stream->Blocked = 0;
+			}
 		}
 
 		if (copied_length)
+		{
 			markers_update_perf_markers(stor_info->Operation,
-			                            stor_info->DS3Offset, 
+			                            start_offset,
 			                            copied_length);
 
-		stor_info->DS3Offset += copied_length;
+			/* Wake a parked stream if we may run one more. */
+			if (aimd_bytes(&stor_info->Aimd, copied_length))
+				pthread_cond_broadcast(&stor_info->Cond);
+		}
 
 		if (!stor_info->Result)
 			stor_info->Result = result;
 		if (stor_info->Result)
+		{
 			copied_length = -1;
+			/* Release the other streams. */
+			pthread_cond_broadcast(&stor_info->Cond);
+		}
 	}
 	pthread_mutex_unlock(&stor_info->Mutex);
 
@@ -318,7 +460,7 @@ stor_wait_for_gridftp(stor_info_t * StorInfo)
 		{
 //			if (StorInfo->Result) break;
 
-//			if (globus_list_size(StorInfo->AllBufferList) == globus_list_size(StorInfo->FreeBufferList))
+//			if (StorInfo->AllBuffers.Count == StorInfo->FreeBuffers.Count)
 			if (StorInfo->CurConnCnt == 0)
 				break;
 
@@ -331,15 +473,41 @@ stor_wait_for_gridftp(stor_info_t * StorInfo)
 void
 stor_destroy_info(stor_info_t * StorInfo)
 {
+	stor_buffer_t * stor_buffer = NULL;
+	bufq_link_t   * link        = NULL;
+	globus_result_t result      = GLOBUS_SUCCESS;
+	int             i           = 0;
+
 	if (StorInfo)
 	{
+		if (StorInfo->Truncate)
+		{
+			result = gds3_async_wait(StorInfo->Truncate);
+			if (result)
+				globus_object_free(globus_error_get(result));
+		}
 		if (StorInfo->Bucket) free(StorInfo->Bucket);
 		if (StorInfo->Object) free(StorInfo->Object);
+		if (StorInfo->Streams) free(StorInfo->Streams);
+		if (StorInfo->Allocations)
+		{
+			for (i = 0; StorInfo->BulkResponse && i < StorInfo->BulkResponse->list_size; i++)
+			{
+				ds3_free_allocate_chunk_response(StorInfo->Allocations[i]);
+			}
+			free(StorInfo->Allocations);
+		}
+		journal_close(StorInfo->Journal);
+		ds3_free_bulk_response(StorInfo->BulkResponse);
 		pthread_mutex_destroy(&StorInfo->Mutex);
 		pthread_cond_destroy(&StorInfo->Cond);
-		globus_list_free(StorInfo->FreeBufferList);
-		globus_list_free(StorInfo->ReadyBufferList);
-		globus_list_destroy_all(StorInfo->AllBufferList, free);
+		while ((link = bufq_list_pop(&StorInfo->AllBuffers)))
+		{
+			stor_buffer = bufq_container(link, stor_buffer_t, AllLink);
+			pool_put(stor_buffer->Buffer, StorInfo->BlockSize);
+			free(stor_buffer);
+		}
+		governor_leave(&StorInfo->Share);
 		free(StorInfo);
 	}
 }
@@ -389,6 +557,495 @@ _find_bulk_response(ds3_client                  * Client,
 	return result;
 }
 
+/*
+ * Looks up the job for a restart in the journal. Leaves *BulkResponse NULL
+ * if this object has no journal or Offset is not the start of a chunk.
+ */
+static globus_result_t
+stor_find_journaled_job(stor_info_t        * StorInfo,
+                        uint64_t             Offset,
+                        ds3_bulk_response ** BulkResponse)
+{
+	globus_result_t result  = GLOBUS_SUCCESS;
+	journal_t     * journal = NULL;
+
+	*BulkResponse = NULL;
+
+	result = journal_open(StorInfo->Client,
+	                      StorInfo->JournalDir,
+	                      StorInfo->Bucket,
+	                      StorInfo->Object,
+	                      StorInfo->TransferInfo->alloc_size,
+	                      &journal);
+	if (result || !journal)
+		return result;
+
+	if (!journal_has_chunk(journal, Offset))
+	{
+		journal_close(journal);
+		return GLOBUS_SUCCESS;
+	}
+
+	result = gds3_get_job(StorInfo->Client, journal_job_id(journal), BulkResponse);
+	if (result)
+	{
+		journal_close(journal);
+		return result;
+	}
+
+	StorInfo->Journal = journal;
+	return GLOBUS_SUCCESS;
+}
+
+/* 1 = chunk I was already uploaded, 0 = it needs uploading. */
+static int
+stor_skip_chunk(stor_info_t * StorInfo, int I)
+{
+	uint64_t offset = StorInfo->BulkResponse->list[I]->list[0].offset;
+
+	// Each chunk has one object
+	assert(StorInfo->BulkResponse->list[I]->size == 1);
+
+	// In case Spectra returns successfully transferred chunks
+	if (offset < StorInfo->RestartOffset)
+		return 1;
+
+	// Chunks after the restart offset may have finished out of order
+	if (StorInfo->Journal && journal_chunk_completed(StorInfo->Journal, offset))
+		return 1;
+
+	return 0;
+}
+
+/*
+ * Called unlocked. Sleeps out a retry_after from the BlackPearl, plus up to
+ * 25% jitter so uploads that were turned away together do not all come back
+ * together. Streams without a chunk do not launch GridFTP reads, so the
+ * receive side stays bounded by the buffers already in flight; keep-alive
+ * perf markers tell the client we are still here.
+ */
+static globus_result_t
+stor_wait_retry_after(stor_info_t  * StorInfo,
+                      uint64_t       RetryAfter,
+                      uint64_t       Offset,
+                      time_t         Deadline,
+                      unsigned int * Seed)
+{
+	globus_result_t result = GLOBUS_SUCCESS;
+	uint64_t        wait   = 0;
+	struct timeval  tv;
+
+	GlobusGFSName(stor_wait_retry_after);
+
+	if (RetryAfter < 1)
+		RetryAfter = 1;
+	wait = RetryAfter + (RetryAfter * (rand_r(Seed) % 26)) / 100;
+
+	while (wait-- && !StorInfo->Result)
+	{
+		if (time(NULL) >= Deadline)
+			return GlobusGFSErrorGeneric("No space on device for incoming file.");
+
+		// Sleep for 1.0 sec
+		tv.tv_sec  = 1;
+		tv.tv_usec = 0;
+		select(0, NULL, NULL, NULL, &tv);
+
+		pthread_mutex_lock(&StorInfo->Mutex);
+		if (StorInfo->MarkerFreq && (time(NULL) - StorInfo->LastMarker) >= StorInfo->MarkerFreq)
+		{
+			markers_update_perf_markers(StorInfo->Operation, Offset, 0);
+			StorInfo->LastMarker = time(NULL);
+		}
+		pthread_mutex_unlock(&StorInfo->Mutex);
+	}
+
+	return result;
+}
+
+/*
+ * Allocates chunks in order, staying up to STOR_ALLOC_AHEAD chunks ahead of
+ * the streams, so allocation round trips overlap the PUTs instead of
+ * sitting between them.
+ */
+void *
+stor_alloc_thread(void * UserArg)
+{
+	ds3_allocate_chunk_response * chunk_response = NULL;
+	ds3_bulk_response           * bulk_response  = NULL;
+	globus_result_t               result         = GLOBUS_SUCCESS;
+	stor_info_t                 * stor_info      = UserArg;
+	uint64_t                      retry_after    = 0;
+	time_t                        deadline       = 0;
+	unsigned int                  seed           = 0;
+	int                           i              = 0;
+	struct timespec               start;
+
+	GlobusGFSName(stor_alloc_thread);
+
+	seed = time(NULL) ^ getpid() ^ (uintptr_t)stor_info;
+
+	bulk_response = stor_info->BulkResponse;
+
+	pthread_mutex_lock(&stor_info->Mutex);
+	{
+		while (!stor_info->Result)
+		{
+			while (stor_info->NextAlloc < bulk_response->list_size &&
+			       stor_skip_chunk(stor_info, stor_info->NextAlloc))
+				stor_info->NextAlloc++;
+
+			if (stor_info->NextAlloc >= bulk_response->list_size)
+				break;
+
+			if (stor_info->NextAlloc - stor_info->NextChunk >= STOR_ALLOC_AHEAD)
+			{
+				pthread_cond_wait(&stor_info->Cond, &stor_info->Mutex);
+				continue;
+			}
+
+			i = stor_info->NextAlloc;
+			pthread_mutex_unlock(&stor_info->Mutex);
+
+			/* Give up if the cache has no room for this chunk by the deadline. */
+			deadline = time(NULL) + stor_info->AllocateTimeout;
+
+			while (1)
+			{
+				clock_gettime(CLOCK_MONOTONIC, &start);
+				result = gds3_allocate_chunk(stor_info->Client,
+				                             bulk_response->list[i]->chunk_id,
+				                             &chunk_response);
+
+				/*
+				 * A busy BlackPearl (503) or a full cache (retry_after)
+				 * means we are pushing too hard; back off and retry.
+				 */
+				pthread_mutex_lock(&stor_info->Mutex);
+				if (error_is_busy(result) || (!result && chunk_response->retry_after))
+					aimd_congested(&stor_info->Aimd);
+				else if (!result)
+					aimd_latency(&stor_info->Aimd, &start);
+				pthread_mutex_unlock(&stor_info->Mutex);
+
+				if (error_is_busy(result))
+				{
+					globus_object_free(globus_error_get(result));
+					result      = GLOBUS_SUCCESS;
+					retry_after = 1;
+				} else
+				{
+					if (result || !chunk_response->retry_after)
+						break;
+
+					retry_after = chunk_response->retry_after;
+					ds3_free_allocate_chunk_response(chunk_response);
+					chunk_response = NULL;
+				}
+
+				result = stor_wait_retry_after(stor_info,
+				                               retry_after,
+				                               bulk_response->list[i]->list[0].offset,
+				                               deadline,
+				                               &seed);
+				if (result || stor_info->Result)
+					break;
+			}
+
+			pthread_mutex_lock(&stor_info->Mutex);
+
+			if (!result && !chunk_response)
+				break;
+
+			if (result)
+			{
+				if (!stor_info->Result)
+					stor_info->Result = result;
+				break;
+			}
+
+			assert(chunk_response->objects->size == 1);
+			stor_info->Allocations[i] = chunk_response;
+			stor_info->NextAlloc++;
+			chunk_response = NULL;
+
+			/* Wake any stream waiting for this chunk. */
+			pthread_cond_broadcast(&stor_info->Cond);
+		}
+
+		/* Release the streams. */
+		pthread_cond_broadcast(&stor_info->Cond);
+	}
+	pthread_mutex_unlock(&stor_info->Mutex);
+
+	return NULL;
+}
+
+/*
+ * Called locked. Holds a stream until the first byte of its chunk is on the
+ * ready list. Data arrives roughly in order, so a PUT opened sooner would
+ * sit on an idle HTTP connection, risking the server's idle timeout, while
+ * the chunks before it drain. Meanwhile we keep the reads going, as
+ * stor_ds3_callout() does.
+ */
+static globus_result_t
+stor_wait_for_chunk_data(stor_info_t * StorInfo, stor_stream_t * StorStream)
+{
+	globus_result_t result = GLOBUS_SUCCESS;
+
+	while (!StorInfo->Result &&
+	       !bufq_table_find(&StorInfo->ReadyBuffers, StorStream->Offset))
+	{
+		if (StorInfo->Eof)
+		{
+			/* No more is coming; the PUT reports any missing data. */
+			if (StorInfo->CurConnCnt == 0 && StorInfo->CopyCnt == 0)
+				break;
+		} else
+		{
+			result = stor_launch_gridftp_reads(StorInfo);
+			if (!result)
+				result = stor_check_reorder_window(StorInfo, StorStream);
+			if (result)
+				break;
+		}
+
+		StorStream->Blocked = 1;
+		pthread_cond_wait(&StorInfo->Cond, &StorInfo->Mutex);
+		StorStream->Blocked = 0;
+	}
+
+	if (!result)
+		result = StorInfo->Result;
+	return result;
+}
+
+/*
+ * Uploads chunks until there are none left. Each stream takes the next
+ * allocated chunk, so several PUTs to the job are in flight at once and
+ * chunks may complete in any order.
+ */
+void *
+stor_stream_thread(void * UserArg)
+{
+	ds3_allocate_chunk_response * chunk_response = NULL;
+	ds3_bulk_response           * bulk_response  = NULL;
+	globus_result_t               result         = GLOBUS_SUCCESS;
+	stor_stream_t               * stor_stream    = UserArg;
+	stor_info_t                 * stor_info      = stor_stream->StorInfo;
+	unsigned int                  seed           = 0;
+	int                           busy           = 0;
+	int                           i              = 0;
+
+	GlobusGFSName(stor_stream_thread);
+
+	bulk_response = stor_info->BulkResponse;
+	seed = time(NULL) ^ getpid() ^ (uintptr_t)stor_stream;
+
+	while (1)
+	{
+		pthread_mutex_lock(&stor_info->Mutex);
+		{
+			i = -1;
+			while (!stor_info->Result)
+			{
+				while (stor_info->NextChunk < bulk_response->list_size &&
+				       stor_skip_chunk(stor_info, stor_info->NextChunk))
+					stor_info->NextChunk++;
+
+				if (stor_info->NextChunk >= bulk_response->list_size)
+					break;
+
+				/* Parked until the controller lets this many streams run. */
+				if (stor_stream - stor_info->Streams >= stor_info->Aimd.Target)
+				{
+					pthread_cond_wait(&stor_info->Cond, &stor_info->Mutex);
+					continue;
+				}
+
+				if (stor_info->Allocations[stor_info->NextChunk])
+				{
+					i = stor_info->NextChunk++;
+					chunk_response = stor_info->Allocations[i];
+					stor_info->Allocations[i] = NULL;
+
+					/* Let the allocator move ahead. */
+					pthread_cond_broadcast(&stor_info->Cond);
+					break;
+				}
+
+				pthread_cond_wait(&stor_info->Cond, &stor_info->Mutex);
+			}
+		}
+		pthread_mutex_unlock(&stor_info->Mutex);
+
+		if (i < 0)
+			break;
+
+		pthread_mutex_lock(&stor_info->Mutex);
+		{
+			// So the callback knows our current offset.
+			stor_stream->Offset = bulk_response->list[i]->list[0].offset;
+			stor_stream->Active = 1;
+
+			result = stor_wait_for_chunk_data(stor_info, stor_stream);
+		}
+		pthread_mutex_unlock(&stor_info->Mutex);
+
+		while (!result)
+		{
+			result = gds3_put_object_for_job(stor_info->Client,
+			                                 stor_info->Bucket,
+			                                 stor_info->Object,
+			                                 chunk_response->objects->list->offset,
+			                                 chunk_response->objects->list->length,
+			                                 bulk_response->job_id->value,
+			                                 stor_ds3_callout,
+			                                 stor_stream);
+			if (!error_is_busy(result))
+				break;
+
+			/*
+			 * Turned away before we sent any of the chunk; the data is still
+			 * in our buffers, so back off and send it again. Once data has
+			 * gone out, it can not be read from the client a second time.
+			 */
+			pthread_mutex_lock(&stor_info->Mutex);
+			busy = (!stor_info->Result &&
+			        stor_stream->Offset == chunk_response->objects->list->offset);
+			if (busy)
+				aimd_congested(&stor_info->Aimd);
+			pthread_mutex_unlock(&stor_info->Mutex);
+
+			if (!busy)
+				break;
+
+			globus_object_free(globus_error_get(result));
+			result = stor_wait_retry_after(stor_info,
+			                               1,
+			                               stor_stream->Offset,
+			                               time(NULL) + stor_info->AllocateTimeout,
+			                               &seed);
+			if (result)
+				break;
+		}
+
+		pthread_mutex_lock(&stor_info->Mutex);
+		{
+			stor_stream->Active = 0;
+
+			// Let our internal error override a generic DS3 eror
+			if (stor_info->Result)
+				result = stor_info->Result;
+
+			if (!result)
+			{
+				markers_update_restart_markers(stor_info->Operation,
+				                               chunk_response->objects->list->offset, 
+				                               chunk_response->objects->list->length);
+				if (stor_info->Journal)
+					journal_complete_chunk(stor_info->Journal,
+					                       chunk_response->objects->list->offset);
+			}
+		}
+		pthread_mutex_unlock(&stor_info->Mutex);
+
+		if (result)
+			break;
+
+		ds3_free_allocate_chunk_response(chunk_response);
+		chunk_response = NULL;
+	}
+
+	ds3_free_allocate_chunk_response(chunk_response);
+
+	pthread_mutex_lock(&stor_info->Mutex);
+	{
+		if (!stor_info->Result)
+			stor_info->Result = result;
+		/* Release the other streams. */
+		if (stor_info->Result)
+			pthread_cond_broadcast(&stor_info->Cond);
+	}
+	pthread_mutex_unlock(&stor_info->Mutex);
+
+	return NULL;
+}
+
+/*
+ * The old object must be gone before its replacement is created. As before,
+ * a failed delete (ex. no such object) is not an error.
+ */
+static void
+stor_wait_truncate(stor_info_t * StorInfo)
+{
+	globus_result_t result = GLOBUS_SUCCESS;
+
+	if (StorInfo->Truncate)
+	{
+		result = gds3_async_wait(StorInfo->Truncate);
+		StorInfo->Truncate = NULL;
+
+		if (result)
+			globus_object_free(globus_error_get(result));
+	}
+}
+
+/*
+ * Small objects go up in one PUT without a bulk job, skipping the job
+ * creation and chunk allocation round trips. Stream 0 pulls the data out of
+ * the GridFTP buffers just as it would for a chunk.
+ */
+static globus_result_t
+stor_put_small_object(stor_info_t * StorInfo)
+{
+	stor_stream_t * stor_stream = NULL;
+	globus_result_t result      = GLOBUS_SUCCESS;
+
+	GlobusGFSName(stor_put_small_object);
+
+	stor_stream = calloc(1, sizeof(stor_stream_t));
+	if (!stor_stream)
+		return GlobusGFSErrorMemory("stor_stream_t");
+
+	stor_stream->StorInfo = StorInfo;
+	stor_stream->Offset   = 0;
+	stor_stream->Active   = 1;
+
+	/* The read callbacks walk Streams; they see it only once it is whole. */
+	pthread_mutex_lock(&StorInfo->Mutex);
+	{
+		StorInfo->Streams   = stor_stream;
+		StorInfo->StreamCnt = 1;
+		StorInfo->Aimd.Max  = 1;
+	}
+	pthread_mutex_unlock(&StorInfo->Mutex);
+
+	result = gds3_put_object(StorInfo->Client,
+	                         StorInfo->Bucket,
+	                         StorInfo->Object,
+	                         StorInfo->TransferInfo->alloc_size,
+	                         stor_ds3_callout,
+	                         stor_stream);
+
+	pthread_mutex_lock(&StorInfo->Mutex);
+	{
+		stor_stream->Active = 0;
+
+		// Let our internal error override a generic DS3 eror
+		if (StorInfo->Result)
+			result = StorInfo->Result;
+
+		if (!result)
+			markers_update_restart_markers(StorInfo->Operation,
+			                               0,
+			                               StorInfo->TransferInfo->alloc_size);
+	}
+	pthread_mutex_unlock(&StorInfo->Mutex);
+
+	return result;
+}
+
 /*
  * We only support transfers with a chunk-boundry offset and lengths to the
  * end of the file.
@@ -397,31 +1054,77 @@ _find_bulk_response(ds3_client                  * Client,
 void *
 stor_thread(void * UserArg)
 {
-	ds3_allocate_chunk_response * chunk_response     = NULL;
 	ds3_get_jobs_response       * get_jobs_response  = NULL;
 	globus_result_t               result             = GLOBUS_SUCCESS;
 	stor_info_t                 * stor_info          = UserArg;
 	ds3_bulk_response           * bulk_response      = NULL;
 	globus_off_t                  offset             = 0;
 	globus_off_t                  length             = 0;
+	stor_stream_t               * streams            = NULL;
+	int                           stream_cnt         = 0;
+	int                           rc                 = 0;
 	int                           i                  = 0;
 
 	GlobusGFSName(stor_thread);
 
-	result = gds3_get_jobs(stor_info->Client, &get_jobs_response);
+	globus_gridftp_server_get_write_range(stor_info->Operation, &offset, &length);
+	if (!length)
+		goto cleanup;
+
+	/*
+	 * Start receiving now rather than after the job is ready. While we find
+	 * or create the job and the first chunk is allocated, the first reads
+	 * fill and wait on the ready list; the streams drain them once they
+	 * have their chunks. The depth target and reorder window bound how much
+	 * we take in before then.
+	 *
+	 * The journal lookup, job scan and job creation below stay in order on
+	 * this thread: each depends on the one before, and this thread has
+	 * nothing else to do until the job exists. The overlap is with the
+	 * data channels, whose reads complete on GridFTP's threads meanwhile.
+	 */
+	globus_gridftp_server_begin_transfer(stor_info->Operation, 0, NULL);
+
+	pthread_mutex_lock(&stor_info->Mutex);
+	result = stor_launch_gridftp_reads(stor_info);
+	pthread_mutex_unlock(&stor_info->Mutex);
 	if (result)
 		goto cleanup;
 
-	globus_gridftp_server_get_write_range(stor_info->Operation, &offset, &length);
-	if (!length)
+	if (offset == 0 &&
+	    stor_info->TransferInfo->alloc_size > 0 &&
+	    stor_info->TransferInfo->alloc_size <= stor_info->SmallObjectSize)
+	{
+		stor_wait_truncate(stor_info);
+		result = stor_put_small_object(stor_info);
 		goto cleanup;
+	}
 
-	result = _find_bulk_response(stor_info->Client,
-	                             stor_info->Bucket,
-	                             stor_info->Object,
-	                             offset,
-	                             get_jobs_response,
-	                             &bulk_response);
+	/*
+	 * With a journal, fresh uploads always start a new job and restarts find
+	 * theirs without listing every job on the BlackPearl. Restarts of jobs
+	 * the journal does not know about fall back to the scan.
+	 */
+	if (stor_info->JournalDir && offset != 0)
+	{
+		result = stor_find_journaled_job(stor_info, offset, &bulk_response);
+		if (result)
+			goto cleanup;
+	}
+
+	if (!bulk_response && (!stor_info->JournalDir || offset != 0))
+	{
+		result = gds3_get_jobs(stor_info->Client, &get_jobs_response);
+		if (result)
+			goto cleanup;
+
+		result = _find_bulk_response(stor_info->Client,
+		                             stor_info->Bucket,
+		                             stor_info->Object,
+		                             offset,
+		                             get_jobs_response,
+		                             &bulk_response);
+	}
 
 	if (!bulk_response && offset != 0)
 	{
@@ -429,6 +1132,9 @@ stor_thread(void * UserArg)
 		goto cleanup;
 	}
 
+	/* The delete ran alongside the job lookup. */
+	stor_wait_truncate(stor_info);
+
 	if (!bulk_response)
 	{
 		result = gds3_init_bulk_put(stor_info->Client,
@@ -444,82 +1150,131 @@ stor_thread(void * UserArg)
 	if (!bulk_response)
 		goto cleanup;
 
-	globus_gridftp_server_begin_transfer(stor_info->Operation, 0, NULL);
+	stor_info->BulkResponse  = bulk_response;
+	stor_info->RestartOffset = offset;
 
-	for (i = 0; i < bulk_response->list_size; i++)
-	{
-		// Each chunk has one object
-		assert(bulk_response->list[i]->size == 1);
+	/*
+	 * The journal only saves time on a restart; if we can not write one,
+	 * the restart falls back to scanning the jobs.
+	 */
+	if (stor_info->JournalDir && !stor_info->Journal)
+		journal_create(stor_info->Client,
+		               stor_info->JournalDir,
+		               stor_info->Bucket,
+		               stor_info->Object,
+		               stor_info->TransferInfo->alloc_size,
+		               bulk_response,
+		               &stor_info->Journal);
 
-		// In case Spectra returns successfully transferred chunks
-		if (bulk_response->list[i]->list[0].offset < offset)
-			continue;
+	/*
+	 * No point in more streams than chunks. StorStreams (Aimd.Max) is the
+	 * most the controller may run; every stream gets a thread up front and
+	 * parks until the controller lets it run.
+	 */
+	stream_cnt = stor_info->Aimd.Max;
+	if (stream_cnt > bulk_response->list_size)
+		stream_cnt = bulk_response->list_size;
+	if (stream_cnt < 1)
+		stream_cnt = 1;
+
+	streams = calloc(stream_cnt, sizeof(stor_stream_t));
+	if (!streams)
+	{
+		result = GlobusGFSErrorMemory("stor_stream_t");
+		goto cleanup;
+	}
+	for (i = 0; i < stream_cnt; i++)
+		streams[i].StorInfo = stor_info;
 
-		result = gds3_allocate_chunk(stor_info->Client,
-		                             bulk_response->list[i]->chunk_id,
-		                             &chunk_response);
-		if (result)
-			goto cleanup;
+	/*
+	 * The read callbacks have been running since we began the transfer and
+	 * walk Streams; they see it only once it is whole.
+	 */
+	pthread_mutex_lock(&stor_info->Mutex);
+	stor_info->Streams   = streams;
+	stor_info->StreamCnt = stream_cnt;
+	pthread_mutex_unlock(&stor_info->Mutex);
 
-		if (chunk_response->retry_after)
-		{
-			result = GlobusGFSErrorGeneric("No space on device for incoming file.");
-			goto cleanup;
-		}
-		assert(chunk_response->objects->size == 1);
+	stor_info->Allocations = calloc(bulk_response->list_size,
+	                                sizeof(ds3_allocate_chunk_response *));
+	if (!stor_info->Allocations)
+	{
+		result = GlobusGFSErrorMemory("ds3_allocate_chunk_response");
+		goto cleanup;
+	}
 
-		// So the callback knows our current offset.
-		stor_info->DS3Offset = bulk_response->list[i]->list[0].offset;
+	rc = pthread_create(&stor_info->AllocThread, NULL, stor_alloc_thread, stor_info);
+	if (rc)
+	{
+		result = GlobusGFSErrorSystemError("Launching chunk allocation thread", rc);
+		goto cleanup;
+	}
 
-		result = gds3_put_object_for_job(stor_info->Client,
-		                                 stor_info->Bucket,
-		                                 stor_info->Object,
-		                                 chunk_response->objects->list->offset,
-		                                 chunk_response->objects->list->length,
-		                                 bulk_response->job_id->value,
-		                                 stor_ds3_callout,
-		                                 stor_info);
+	/*
+	 * Stream 0 runs on this thread. If we can not launch the others, carry
+	 * on with the streams we have.
+	 */
+	for (i = 1; i < stream_cnt; i++)
+	{
+		if (pthread_create(&streams[i].Thread, NULL, stor_stream_thread, &streams[i]))
+			break;
+	}
 
-		// Let our internal error override a generic DS3 eror
-		if (stor_info->Result)
-			result = stor_info->Result;
-		if (result)
-			goto cleanup;
+	pthread_mutex_lock(&stor_info->Mutex);
+	stor_info->StreamCnt = i;
+	if (stor_info->Aimd.Max > i)
+		stor_info->Aimd.Max = i;
+	pthread_mutex_unlock(&stor_info->Mutex);
 
-		markers_update_restart_markers(stor_info->Operation,
-		                               chunk_response->objects->list->offset, 
-		                               chunk_response->objects->list->length);
+	stor_stream_thread(&stor_info->Streams[0]);
 
-		ds3_free_allocate_chunk_response(chunk_response);
-		chunk_response = NULL;
+	for (i = 1; i < stor_info->StreamCnt; i++)
+	{
+		pthread_join(stor_info->Streams[i].Thread, NULL);
 	}
 
+	/* The allocator exits once every chunk is allocated or on error. */
+	pthread_join(stor_info->AllocThread, NULL);
+
 cleanup:
 	stor_wait_for_gridftp(stor_info);
 
 	if (!result)
 		result = stor_info->Result;
+
+	/* Lookups made while the data was moving may have cached the old object. */
+	if (stor_info->Bucket && stor_info->Object)
+		mdcache_invalidate(stor_info->Client, stor_info->Bucket, stor_info->Object);
+
+	/* Keep the journal for a restart only if the upload failed. */
+	if (!result)
+	{
+		journal_remove(stor_info->Journal);
+		stor_info->Journal = NULL;
+	}
+
+	depth_log(&stor_info->Depth, "STOR", stor_info->TransferInfo->pathname);
+	aimd_log(&stor_info->Aimd, "STOR", stor_info->TransferInfo->pathname);
+
 	globus_gridftp_server_finished_transfer(stor_info->Operation, result);
 	ds3_free_get_jobs_response(get_jobs_response);
-	ds3_free_bulk_response(bulk_response);
-	ds3_free_allocate_chunk_response(chunk_response);
+	if (!stor_info->BulkResponse)
+		ds3_free_bulk_response(bulk_response);
 	stor_destroy_info(stor_info);
 	return NULL;
 }
 
 void
 stor(ds3_client                 * Client, 
+     config_t                   * Config,
      globus_gfs_operation_t       Operation,
      globus_gfs_transfer_info_t * TransferInfo)
 {
-	globus_result_t result    = GLOBUS_SUCCESS;
-	stor_info_t   * stor_info = NULL;
-	char          * bucket    = NULL;
-	char          * object    = NULL;
-	int             rc        = 0;
-	int             initted   = 0;
-	pthread_t       thread;
-	pthread_attr_t  attr;
+	globus_result_t result       = GLOBUS_SUCCESS;
+	stor_info_t   * stor_info    = NULL;
+	char          * bucket       = NULL;
+	char          * object       = NULL;
+	int             opt_conn_cnt = 0;
 
 	GlobusGFSName(stor);
 
@@ -532,9 +1287,6 @@ stor(ds3_client                 * Client,
 		return;
 	}
 
-	if (TransferInfo->truncate)
-		gds3_delete_object(Client, bucket, object);
-
 	stor_info = malloc(sizeof(stor_info_t));
 	if (!stor_info)
 	{
@@ -548,26 +1300,56 @@ stor(ds3_client                 * Client,
 	memset(stor_info, 0, sizeof(stor_info_t));
 	pthread_mutex_init(&stor_info->Mutex, NULL);
 	pthread_cond_init(&stor_info->Cond, NULL);
+	governor_join(&stor_info->Share);
+	bufq_list_init(&stor_info->AllBuffers);
 	stor_info->Client       = Client;
 	stor_info->Operation    = Operation;
 	stor_info->TransferInfo = TransferInfo;
 	stor_info->Bucket       = bucket;
 	stor_info->Object       = object;
+	stor_info->JournalDir   = Config->JournalDir;
+	stor_info->AllocateTimeout = Config->AllocateTimeout;
+	stor_info->SmallObjectSize = (uint64_t)Config->SmallObjectSize * 1024;
 
 	globus_gridftp_server_get_block_size(Operation, &stor_info->BlockSize);
+	stor_info->BufferSize = pool_class_size(stor_info->BlockSize);
+	globus_gridftp_server_get_update_interval(Operation, &stor_info->MarkerFreq);
+	stor_info->LastMarker = time(NULL);
+
+	/* Start from the server's suggestion; the controller takes it from there. */
+	globus_gridftp_server_get_optimal_concurrency(Operation, &opt_conn_cnt);
+	depth_init(&stor_info->Depth, opt_conn_cnt);
+	aimd_init(&stor_info->Aimd, Config->StorStreams);
 
 	/*
-	 * Launch a detached thread.
+	 * Start removing the old object now; the worker waits for it. If the
+	 * delete can not be queued, do it here as before.
 	 */
-	if ((rc = pthread_attr_init(&attr)) || !(initted = 1) ||
-	    (rc = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) ||
-	    (rc = pthread_create(&thread, &attr, stor_thread, stor_info)))
+	if (TransferInfo->truncate)
 	{
-		result = GlobusGFSErrorSystemError("Launching put object thread", rc);
+		result = gds3_async_delete_object(Client,
+		                                  bucket,
+		                                  object,
+		                                  &stor_info->Truncate);
+		if (result)
+		{
+			/* Fall back to deleting it now; a missing object is fine. */
+			globus_object_free(globus_error_get(result));
+			result = gds3_delete_object(Client, bucket, object);
+			if (result)
+				globus_object_free(globus_error_get(result));
+		}
+	}
+
+	/*
+	 * Hand off to a worker.
+	 */
+	result = workers_submit(WORKERS_STOR, stor_thread, stor_info);
+	if (result)
+	{
+		result = GlobusGFSErrorWrapFailed("Launching put object thread", result);
 		globus_gridftp_server_finished_transfer(Operation, result);
 		stor_destroy_info(stor_info);
 	}
-
-	if (initted) pthread_attr_destroy(&attr);
 }
 
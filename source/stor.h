@@ -42,31 +42,73 @@
 #ifndef BLACKPEARL_DSI_STOR_H
 #define BLACKPEARL_DSI_STOR_H
 
+/*
+ * System includes
+ */
+#include <pthread.h>
+#include <time.h>
+
 /*
  * Globus includes
  */
 #include <globus_gridftp_server.h>
-#include <globus_list.h>
 
 /*
  * DS3 includes
  */
 #include <ds3.h>
 
+/*
+ * Local includes
+ */
+#include "config.h"
+#include "journal.h"
+#include "governor.h"
+#include "bufq.h"
+#include "gds3_async.h"
+#include "depth.h"
+#include "aimd.h"
+
 /*
  * Because of the sequential, ascending nature of offsets with DS3,
  * we do not need a range list.
  */
 struct stor_info;
 
+/*
+ * Maximum number of buffers we will hold, beyond the optimal concurrency,
+ * while waiting for an earlier offset from another parallel data channel.
+ */
+#define STOR_REORDER_WINDOW 64
+
+/*
+ * Number of chunks allocated ahead of the streams so the next PUT can start
+ * as soon as a stream finishes its current chunk.
+ */
+#define STOR_ALLOC_AHEAD 2
+
 typedef struct {
 	char             * Buffer;
 	globus_off_t       BufferOffset;   // Moves as buffer is consumed
 	globus_off_t       TransferOffset; // Moves as BufferOffset moves
 	globus_off_t       BufferLength;   // Moves as BufferOffset moves
 	struct stor_info * StorInfo;
+	bufq_link_t        AllLink;        // On AllBuffers
+	bufq_entry_t       Entry;          // On ReadyBuffers or FreeBuffers
 } stor_buffer_t;
 
+/*
+ * One per concurrent chunk upload. Each stream runs its own PUT and pulls
+ * the offset range of its chunk out of the shared GridFTP buffers.
+ */
+typedef struct {
+	struct stor_info * StorInfo;
+	pthread_t          Thread;
+	uint64_t           Offset;  // Moves as the chunk is uploaded
+	int                Active;  // Inside a PUT
+	int                Blocked; // Waiting on GridFTP for Offset
+} stor_stream_t;
+
 typedef struct stor_info {
 	globus_gfs_operation_t       Operation;
 	globus_gfs_transfer_info_t * TransferInfo;
@@ -76,25 +118,54 @@ typedef struct stor_info {
 	int                          Started;
 	globus_result_t              Result;
 	globus_size_t                BlockSize;
+	globus_size_t                BufferSize; // BlockSize's pool size class; what the governor counts
 
 	pthread_mutex_t              Mutex;
 	pthread_cond_t               Cond;
 
-	uint64_t                     DS3Offset;
 	globus_bool_t                Eof;
 
-	int OptConnCnt;
-	int ConnChkCnt;
+	ds3_bulk_response          * BulkResponse;
+	globus_off_t                 RestartOffset;
+	int                          NextChunk;
+
+	/* Allocated chunks waiting for a stream, indexed like BulkResponse. */
+	ds3_allocate_chunk_response ** Allocations;
+	int                            NextAlloc;
+	pthread_t                      AllocThread;
+	int                            AllocateTimeout;
+
+	/* Uploads of this many bytes or less skip the bulk job. */
+	uint64_t                     SmallObjectSize;
+
+	int                          MarkerFreq;
+	time_t                       LastMarker;
+
+	char                       * JournalDir;
+	journal_t                  * Journal;
+
+	/* Delete of the old object when truncating, still in flight. */
+	gds3_async_t               * Truncate;
+
+	stor_stream_t              * Streams;
+	int                          StreamCnt; // Launched, 0 until Streams is set; Aimd.Target may run
+	aimd_t                       Aimd;
+
+	depth_t Depth; // Reads to keep in flight
 	int CurConnCnt;
+	int CopyCnt;    // Buffers off ReadyBuffers being copied to DS3
+
+	governor_share_t Share;
 
-	globus_list_t * AllBufferList;
-	globus_list_t * ReadyBufferList;
-	globus_list_t * FreeBufferList;
+	bufq_list_t  AllBuffers;
+	bufq_table_t ReadyBuffers; // Keyed by TransferOffset
+	bufq_stack_t FreeBuffers;
 
 } stor_info_t;
 
 void
 stor(ds3_client                 * Client, 
+     config_t                   * Config,
      globus_gfs_operation_t       Operation,
      globus_gfs_transfer_info_t * TransferInfo);
 
@@ -0,0 +1,264 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * System includes
+ */
+#include <sys/time.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+/*
+ * Local includes
+ */
+#include "workers.h"
+
+typedef struct workers_job {
+	struct workers_job * Next;
+	workers_type_t       Type;
+	void             * (*Func)(void *);
+	void               * Arg;
+	struct timeval       QueueTime;
+} workers_job_t;
+
+static pthread_mutex_t workers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  workers_cond  = PTHREAD_COND_INITIALIZER;
+static workers_job_t * workers_head  = NULL;
+static workers_job_t * workers_tail  = NULL;
+static int             workers_max   = WORKERS_DEFAULT_MAX;
+static int             workers_limit[WORKERS_TYPE_CNT];
+static int             workers_running[WORKERS_TYPE_CNT];
+static int             workers_idle  = 0;
+static int             workers_wakeups = 0; // Signals sent that no idle worker has taken yet
+static workers_stats_t workers_stats;
+
+void
+workers_set_limits(int MaxWorkers, int TypeLimits[WORKERS_TYPE_CNT])
+{
+	int i = 0;
+
+	pthread_mutex_lock(&workers_mutex);
+	{
+		workers_max = MaxWorkers;
+		for (i = 0; i < WORKERS_TYPE_CNT; i++)
+		{
+			workers_limit[i] = TypeLimits[i];
+		}
+	}
+	pthread_mutex_unlock(&workers_mutex);
+}
+
+/*
+ * Called locked. Removes and returns the oldest job whose type is under its
+ * limit, or NULL if there is none.
+ */
+static workers_job_t *
+workers_next_job()
+{
+	workers_job_t * prev = NULL;
+	workers_job_t * job  = NULL;
+
+	for (job = workers_head; job; prev = job, job = job->Next)
+	{
+		if (workers_limit[job->Type] && workers_running[job->Type] >= workers_limit[job->Type])
+			continue;
+
+		if (prev)
+			prev->Next = job->Next;
+		else
+			workers_head = job->Next;
+		if (workers_tail == job)
+			workers_tail = prev;
+
+		workers_stats.Queued--;
+		return job;
+	}
+	return NULL;
+}
+
+/* Called locked. */
+static void
+workers_account_wait(workers_job_t * Job)
+{
+	struct timeval now;
+	uint64_t       wait = 0;
+
+	gettimeofday(&now, NULL);
+	wait = (now.tv_sec - Job->QueueTime.tv_sec) * 1000000ULL +
+	       (now.tv_usec - Job->QueueTime.tv_usec);
+
+	workers_stats.Jobs++;
+	workers_stats.WaitUsec += wait;
+	if (wait > workers_stats.MaxWaitUsec)
+		workers_stats.MaxWaitUsec = wait;
+}
+
+static void *
+workers_thread(void * Arg)
+{
+	workers_job_t * job = NULL;
+
+	pthread_mutex_lock(&workers_mutex);
+	while (1)
+	{
+		job = workers_next_job();
+		if (!job)
+		{
+			workers_idle++;
+			pthread_cond_wait(&workers_cond, &workers_mutex);
+			workers_idle--;
+			if (workers_wakeups > 0)
+				workers_wakeups--;
+			continue;
+		}
+
+		workers_running[job->Type]++;
+		workers_account_wait(job);
+		pthread_mutex_unlock(&workers_mutex);
+
+		job->Func(job->Arg);
+
+		pthread_mutex_lock(&workers_mutex);
+		workers_running[job->Type]--;
+		free(job);
+
+		/* A job held back by its type's limit may be able to run now. */
+		if (workers_head)
+			pthread_cond_broadcast(&workers_cond);
+	}
+	pthread_mutex_unlock(&workers_mutex);
+
+	return NULL;
+}
+
+globus_result_t
+workers_submit(workers_type_t Type, void * (*Func)(void *), void * Arg)
+{
+	globus_result_t result = GLOBUS_SUCCESS;
+	workers_job_t * job    = NULL;
+	pthread_attr_t  attr;
+	pthread_t       thread;
+	int             rc     = 0;
+
+	GlobusGFSName(workers_submit);
+
+	job = malloc(sizeof(workers_job_t));
+	if (!job)
+		return GlobusGFSErrorMemory("workers_job_t");
+
+	job->Next = NULL;
+	job->Type = Type;
+	job->Func = Func;
+	job->Arg  = Arg;
+	gettimeofday(&job->QueueTime, NULL);
+
+	pthread_mutex_lock(&workers_mutex);
+	{
+		if (workers_tail)
+			workers_tail->Next = job;
+		else
+			workers_head = job;
+		workers_tail = job;
+
+		workers_stats.Queued++;
+		if (workers_stats.Queued > workers_stats.QueuedHighWater)
+			workers_stats.QueuedHighWater = workers_stats.Queued;
+
+		/*
+		 * An idle worker counts only if no earlier job has already been
+		 * promised it; otherwise this job would queue behind that one
+		 * while we could have started another worker.
+		 */
+		if (workers_idle > workers_wakeups)
+		{
+			workers_wakeups++;
+			pthread_cond_signal(&workers_cond);
+			goto unlock;
+		}
+
+		if (workers_stats.Threads >= workers_max)
+		{
+			pthread_cond_signal(&workers_cond);
+			goto unlock;
+		}
+
+		/* Add a worker. Too small a stack for this system keeps the default. */
+		if ((rc = pthread_attr_init(&attr)) == 0)
+		{
+			pthread_attr_setstacksize(&attr, WORKERS_STACK_SIZE);
+			if ((rc = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) == 0)
+				rc = pthread_create(&thread, &attr, workers_thread, NULL);
+			pthread_attr_destroy(&attr);
+		}
+
+		if (rc == 0)
+		{
+			workers_stats.Threads++;
+			goto unlock;
+		}
+
+		/* The job will wait for an existing worker. With none, give up. */
+		if (workers_stats.Threads == 0)
+		{
+			workers_head = workers_tail = NULL;
+			workers_stats.Queued--;
+			free(job);
+			result = GlobusGFSErrorSystemError("Launching worker thread", rc);
+		}
+	}
+unlock:
+	pthread_mutex_unlock(&workers_mutex);
+
+	return result;
+}
+
+void
+workers_get_stats(workers_stats_t * Stats)
+{
+	pthread_mutex_lock(&workers_mutex);
+	*Stats = workers_stats;
+	pthread_mutex_unlock(&workers_mutex);
+}
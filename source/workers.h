@@ -0,0 +1,102 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * Process-wide pool of worker threads. STOR, RETR, CKSM and the DS3 commands
+ * queue their work here instead of creating a thread per operation. Workers
+ * are created as needed up to a limit and then kept for the next job. Each
+ * type of work may also be limited to a number of workers at once.
+ */
+
+#ifndef BLACKPEARL_DSI_WORKERS_H
+#define BLACKPEARL_DSI_WORKERS_H
+
+/*
+ * System includes
+ */
+#include <stdint.h>
+
+/*
+ * Globus includes
+ */
+#include <globus_gridftp_server.h>
+
+#define WORKERS_DEFAULT_MAX 64
+/*
+ * Stack for each worker. Jobs keep their buffers on the heap; the deepest
+ * stacks are libcurl and OpenSSL under the DS3 calls, far below this.
+ */
+#define WORKERS_STACK_SIZE  (1024 * 1024)
+
+typedef enum {
+	WORKERS_STOR,
+	WORKERS_RETR,
+	WORKERS_CKSM,
+	WORKERS_COMMAND,
+	WORKERS_TYPE_CNT
+} workers_type_t;
+
+typedef struct {
+	uint64_t Threads;         // Workers created
+	uint64_t Queued;          // Jobs waiting for a worker
+	uint64_t QueuedHighWater; // Most jobs ever waiting at once
+	uint64_t Jobs;            // Jobs started
+	uint64_t WaitUsec;        // Total time jobs waited for a worker
+	uint64_t MaxWaitUsec;     // Longest time a job waited for a worker
+} workers_stats_t;
+
+/*
+ * MaxWorkers bounds the pool. TypeLimits[type] bounds the workers running
+ * that type of job at once; 0 means no limit beyond MaxWorkers.
+ */
+void
+workers_set_limits(int MaxWorkers, int TypeLimits[WORKERS_TYPE_CNT]);
+
+/*
+ * Queues Func(Arg) to run on a worker. On error, Func is never called.
+ */
+globus_result_t
+workers_submit(workers_type_t Type, void * (*Func)(void *), void * Arg);
+
+void
+workers_get_stats(workers_stats_t * Stats);
+
+#endif /* BLACKPEARL_DSI_WORKERS_H */
@@ -0,0 +1,258 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * Per-buffer bookkeeping cost of STOR's ready and free buffers: the bufq
+ * offset table and free stack against the globus_list code they replaced
+ * (a malloc'd node per insert, a linear globus_list_search_pred() to find
+ * the next offset). The list below behaves like globus_list so the bench
+ * needs no Globus runtime.
+ *
+ * Each round fills Depth buffers that arrive in a shuffled order, as they
+ * do from parallel data channels, then takes them out by offset, as the
+ * DS3 writer does, and returns them to the free list.
+ *
+ *   cc -O2 -I../source -o bufq_bench bufq_bench.c ../source/bufq.c
+ *   ./bufq_bench [buffers]
+ */
+
+/*
+ * System includes
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Local includes
+ */
+#include "bufq.h"
+
+typedef struct {
+	bufq_entry_t Entry;
+	uint64_t     TransferOffset;
+} bench_buffer_t;
+
+/*
+ * The globus_list calls stor.c used, minus the Globus memory pools.
+ */
+typedef struct bench_list {
+	void              * Datum;
+	struct bench_list * Next;
+} bench_list_t;
+
+static void
+bench_list_insert(bench_list_t ** List, void * Datum)
+{
+	bench_list_t * node = malloc(sizeof(bench_list_t));
+
+	node->Datum = Datum;
+	node->Next  = *List;
+	*List       = node;
+}
+
+static bench_list_t **
+bench_list_search_pred(bench_list_t ** List, uint64_t Offset)
+{
+	for (; *List; List = &(*List)->Next)
+	{
+		if (((bench_buffer_t *)(*List)->Datum)->TransferOffset == Offset)
+			return List;
+	}
+	return NULL;
+}
+
+static void *
+bench_list_remove(bench_list_t ** Entry)
+{
+	bench_list_t * node  = *Entry;
+	void         * datum = node->Datum;
+
+	*Entry = node->Next;
+	free(node);
+	return datum;
+}
+
+static double
+bench_now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+bench_shuffle(int * Order, int Count)
+{
+	int i   = 0;
+	int j   = 0;
+	int tmp = 0;
+
+	for (i = 0; i < Count; i++)
+		Order[i] = i;
+	for (i = Count - 1; i > 0; i--)
+	{
+		j        = rand() % (i + 1);
+		tmp      = Order[i];
+		Order[i] = Order[j];
+		Order[j] = tmp;
+	}
+}
+
+/* Returns nanoseconds per buffer. */
+static double
+bench_globus_list(bench_buffer_t * Buffers, int * Order, int Depth, long Rounds)
+{
+	bench_list_t    * ready     = NULL;
+	bench_list_t    * free_list = NULL;
+	bench_list_t   ** entry     = NULL;
+	bench_buffer_t  * buffer    = NULL;
+	uint64_t          offset    = 0;
+	double            start     = 0;
+	long              round     = 0;
+	int               i         = 0;
+
+	for (i = 0; i < Depth; i++)
+		bench_list_insert(&free_list, &Buffers[i]);
+
+	start = bench_now();
+	for (round = 0; round < Rounds; round++)
+	{
+		for (i = 0; i < Depth; i++)
+		{
+			buffer = bench_list_remove(&free_list);
+			buffer->TransferOffset = offset + Order[i];
+			bench_list_insert(&ready, buffer);
+		}
+
+		for (i = 0; i < Depth; i++, offset++)
+		{
+			entry = bench_list_search_pred(&ready, offset);
+			if (!entry)
+			{
+				fprintf(stderr, "globus_list: lost offset %llu\n", (unsigned long long)offset);
+				exit(1);
+			}
+			bench_list_insert(&free_list, bench_list_remove(entry));
+		}
+	}
+	start = bench_now() - start;
+
+	while (free_list)
+		bench_list_remove(&free_list);
+	return start * 1e9 / ((double)Rounds * Depth);
+}
+
+static double
+bench_bufq(bench_buffer_t * Buffers, int * Order, int Depth, long Rounds)
+{
+	bufq_table_t     ready;
+	bufq_stack_t     free_stack;
+	bufq_entry_t   * entry  = NULL;
+	bench_buffer_t * buffer = NULL;
+	uint64_t         offset = 0;
+	double           start  = 0;
+	long             round  = 0;
+	int              i      = 0;
+
+	memset(&ready, 0, sizeof(ready));
+	memset(&free_stack, 0, sizeof(free_stack));
+
+	for (i = 0; i < Depth; i++)
+		bufq_stack_push(&free_stack, &Buffers[i].Entry);
+
+	start = bench_now();
+	for (round = 0; round < Rounds; round++)
+	{
+		for (i = 0; i < Depth; i++)
+		{
+			buffer = bufq_container(bufq_stack_pop(&free_stack), bench_buffer_t, Entry);
+			buffer->TransferOffset = offset + Order[i];
+			bufq_table_insert(&ready, &buffer->Entry, buffer->TransferOffset);
+		}
+
+		for (i = 0; i < Depth; i++, offset++)
+		{
+			entry = bufq_table_remove(&ready, offset);
+			if (!entry)
+			{
+				fprintf(stderr, "bufq: lost offset %llu\n", (unsigned long long)offset);
+				exit(1);
+			}
+			bufq_stack_push(&free_stack, entry);
+		}
+	}
+	start = bench_now() - start;
+
+	return start * 1e9 / ((double)Rounds * Depth);
+}
+
+int
+main(int argc, char * argv[])
+{
+	static const int depths[] = {4, 16, 64, 256};
+	bench_buffer_t   buffers[256];
+	int              order[256];
+	long             buffer_cnt = 10000000;
+	long             rounds     = 0;
+	int              i          = 0;
+
+	if (argc > 1)
+		buffer_cnt = atol(argv[1]);
+
+	srand(1);
+	printf("%6s %16s %16s\n", "depth", "globus_list ns", "bufq ns");
+	for (i = 0; i < sizeof(depths) / sizeof(depths[0]); i++)
+	{
+		bench_shuffle(order, depths[i]);
+		rounds = buffer_cnt / depths[i];
+		if (rounds < 1)
+			rounds = 1;
+
+		printf("%6d %16.1f %16.1f\n",
+		       depths[i],
+		       bench_globus_list(buffers, order, depths[i], rounds),
+		       bench_bufq(buffers, order, depths[i], rounds));
+	}
+	return 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * Throughput of the streaming ListBucketResult parser. Builds one page of
+ * Keys Contents entries the way the BlackPearl writes them, every hundredth
+ * key carrying escapes, then feeds it to the parser in random-sized slices
+ * as curl would hand them over. Fails unless every entry arrives and the
+ * last one is the last key written.
+ *
+ *   cc -O2 -I../source -o listing_bench listing_bench.c ../source/listing.c
+ *   ./listing_bench [keys] [max slice bytes]
+ */
+
+/*
+ * System includes
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Local includes
+ */
+#include "listing.h"
+
+typedef struct {
+	long Count;
+	char LastKey[LISTING_KEY_MAX];
+} bench_result_t;
+
+static double
+bench_now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Key number Index as it reads after unescaping. */
+static void
+bench_key(long Index, char * Key, size_t KeySize)
+{
+	if (Index % 100 == 0)
+		snprintf(Key, KeySize, "dir/R&D <%07ld> \xc3\xa9", Index);
+	else
+		snprintf(Key, KeySize, "dir/file-%07ld.dat", Index);
+}
+
+/* The page as one string; Length is set to its size. */
+static char *
+bench_document(long Keys, size_t * Length)
+{
+	size_t   size   = 256 + Keys * 320;
+	size_t   used   = 0;
+	char   * doc    = malloc(size);
+	long     i      = 0;
+
+	if (!doc)
+		return NULL;
+
+	used += sprintf(doc + used,
+	                "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+	                "<ListBucketResult><Name>bench</Name><Prefix>dir/</Prefix>"
+	                "<Marker/><MaxKeys>%ld</MaxKeys><IsTruncated>false</IsTruncated>",
+	                Keys);
+
+	for (i = 0; i < Keys; i++)
+	{
+		used += sprintf(doc + used, "<Contents><Key>");
+		if (i % 100 == 0)
+			used += sprintf(doc + used, "dir/R&amp;D &lt;%07ld&gt; &#xE9;", i);
+		else
+			used += sprintf(doc + used, "dir/file-%07ld.dat", i);
+		used += sprintf(doc + used,
+		                "</Key><LastModified>2015-06-01T12:00:00.000Z</LastModified>"
+		                "<ETag>\"0123456789abcdef0123456789abcdef\"</ETag>"
+		                "<Size>%ld</Size><StorageClass>STANDARD</StorageClass>"
+		                "<Owner><ID>0b1f2a3c</ID><DisplayName>bench</DisplayName></Owner>"
+		                "</Contents>",
+		                i * 4096);
+	}
+
+	used += sprintf(doc + used, "</ListBucketResult>");
+	*Length = used;
+	return doc;
+}
+
+static int
+bench_callback(listing_entry_t * Entry, void * CallbackArg)
+{
+	bench_result_t * result = CallbackArg;
+
+	result->Count++;
+	strcpy(result->LastKey, Entry->Key);
+	return 0;
+}
+
+int
+main(int argc, char * argv[])
+{
+	static listing_parser_t parser;
+	bench_result_t          result;
+	char                    last_key[LISTING_KEY_MAX];
+	char                  * doc       = NULL;
+	size_t                  length    = 0;
+	size_t                  offset    = 0;
+	size_t                  slice     = 0;
+	long                    keys      = 1000000;
+	long                    max_slice = 16384;
+	double                  elapsed   = 0;
+
+	if (argc > 1)
+		keys = atol(argv[1]);
+	if (argc > 2)
+		max_slice = atol(argv[2]);
+	if (keys < 1 || max_slice < 1)
+	{
+		fprintf(stderr, "usage: %s [keys] [max slice bytes]\n", argv[0]);
+		return 1;
+	}
+
+	doc = bench_document(keys, &length);
+	if (!doc)
+	{
+		fprintf(stderr, "No memory for a %ld key page\n", keys);
+		return 1;
+	}
+
+	memset(&result, 0, sizeof(result));
+	listing_parser_init(&parser, bench_callback, &result);
+
+	srand(1);
+	elapsed = bench_now();
+	for (offset = 0; offset < length; offset += slice)
+	{
+		slice = 1 + rand() % max_slice;
+		if (slice > length - offset)
+			slice = length - offset;
+
+		if (listing_parser_feed(&parser, doc + offset, slice))
+		{
+			fprintf(stderr, "Parse failed at byte %zu\n", offset);
+			return 1;
+		}
+	}
+	elapsed = bench_now() - elapsed;
+
+	bench_key(keys - 1, last_key, sizeof(last_key));
+	if (result.Count != keys || strcmp(result.LastKey, last_key) != 0)
+	{
+		fprintf(stderr, "Got %ld entries ending with '%s'; wanted %ld ending with '%s'\n",
+		        result.Count, result.LastKey, keys, last_key);
+		return 1;
+	}
+	if (listing_parser_next_marker(&parser))
+	{
+		fprintf(stderr, "Untruncated page asked for another\n");
+		return 1;
+	}
+
+	printf("%ld keys, %.1f MB in %.3f s: %.1f MB/s, %.0f keys/s\n",
+	       keys,
+	       length / 1e6,
+	       elapsed,
+	       length / 1e6 / elapsed,
+	       keys / elapsed);
+
+	free(doc);
+	return 0;
+}
@@ -0,0 +1,392 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2015 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://www.ncsa.illinois.edu
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+
+/*
+ * Files per second for small objects, the way STOR and RETR moved them
+ * before SmallObjectSize (a bulk job, a chunk allocation or availability
+ * check, then a job-scoped PUT or GET) against the single direct PUT or
+ * GET they use now. Needs a BlackPearl and an existing bucket; the bench
+ * writes, reads back and deletes objects under small_object_bench/.
+ *
+ *   cc -O2 -o small_object_bench small_object_bench.c -lds3
+ *   DS3_ACCESS_KEY=... DS3_SECRET_KEY=... \
+ *       ./small_object_bench <endpoint> <bucket> [files] [bytes]
+ */
+
+/*
+ * System includes
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+/*
+ * DS3 includes
+ */
+#include <ds3.h>
+
+typedef struct {
+	char   * Data;
+	size_t   Length;
+	size_t   Offset;
+} bench_buffer_t;
+
+static double
+bench_now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Returns 0, or prints the error, frees it and returns -1. */
+static int
+bench_check(ds3_error * Error, const char * What)
+{
+	if (!Error)
+		return 0;
+
+	if (Error->error && Error->error->error_body)
+		fprintf(stderr, "%s: %s\n", What, ds3_str_value(Error->error->error_body));
+	else
+		fprintf(stderr, "%s: %s\n", What, Error->message ? ds3_str_value(Error->message) : "failed");
+	ds3_free_error(Error);
+	return -1;
+}
+
+static size_t
+bench_read(void * Buffer, size_t Size, size_t Count, void * UserArg)
+{
+	bench_buffer_t * buffer = UserArg;
+	size_t           length = Size * Count;
+
+	if (length > buffer->Length - buffer->Offset)
+		length = buffer->Length - buffer->Offset;
+	memcpy(Buffer, buffer->Data + buffer->Offset, length);
+	buffer->Offset += length;
+	return length;
+}
+
+static size_t
+bench_write(void * Buffer, size_t Size, size_t Count, void * UserArg)
+{
+	bench_buffer_t * buffer = UserArg;
+	size_t           length = Size * Count;
+
+	if (length > buffer->Length - buffer->Offset)
+		return 0;
+	memcpy(buffer->Data + buffer->Offset, Buffer, length);
+	buffer->Offset += length;
+	return length;
+}
+
+static ds3_error *
+bench_bulk(ds3_client         * Client,
+           char               * Bucket,
+           char               * Object,
+           uint64_t             Length,
+           int                  Put,
+           ds3_bulk_response ** Response)
+{
+	ds3_bulk_object_list list;
+	ds3_bulk_object      object;
+	ds3_request        * request = NULL;
+	ds3_error          * error   = NULL;
+
+	memset(&list, 0, sizeof(list));
+	memset(&object, 0, sizeof(object));
+	list.size     = 1;
+	list.list     = &object;
+	object.name   = ds3_str_init(Object);
+	object.length = Length;
+
+	if (Put)
+		request = ds3_init_put_bulk(Bucket, &list);
+	else
+		request = ds3_init_get_bulk(Bucket, &list, NONE);
+	error = ds3_bulk(Client, request, Response);
+	ds3_str_free(object.name);
+	ds3_free_request(request);
+	return error;
+}
+
+/* The bulk job path: job, chunk allocation, job-scoped PUT. */
+static int
+bench_put_bulk(ds3_client * Client, char * Bucket, char * Object, bench_buffer_t * Buffer)
+{
+	ds3_allocate_chunk_response * chunk    = NULL;
+	ds3_bulk_response           * response = NULL;
+	ds3_request                 * request  = NULL;
+	ds3_error                   * error    = NULL;
+
+	if (bench_check(bench_bulk(Client, Bucket, Object, Buffer->Length, 1, &response), "Bulk put"))
+		return -1;
+
+	while (1)
+	{
+		request = ds3_init_allocate_chunk(response->list[0]->chunk_id->value);
+		error   = ds3_allocate_chunk(Client, request, &chunk);
+		ds3_free_request(request);
+		if (bench_check(error, "Allocate chunk"))
+			goto failed;
+		if (!chunk->retry_after)
+			break;
+		sleep(chunk->retry_after);
+		ds3_free_allocate_chunk_response(chunk);
+		chunk = NULL;
+	}
+	ds3_free_allocate_chunk_response(chunk);
+
+	Buffer->Offset = 0;
+	request = ds3_init_put_object_for_job(Bucket,
+	                                      Object,
+	                                      0,
+	                                      Buffer->Length,
+	                                      response->job_id->value);
+	error   = ds3_put_object(Client, request, Buffer, bench_read);
+	ds3_free_request(request);
+	if (bench_check(error, "Put object for job"))
+		goto failed;
+
+	ds3_free_bulk_response(response);
+	return 0;
+
+failed:
+	ds3_free_bulk_response(response);
+	return -1;
+}
+
+/* The bulk job path: job, wait for the chunk, job-scoped GET. */
+static int
+bench_get_bulk(ds3_client * Client, char * Bucket, char * Object, bench_buffer_t * Buffer)
+{
+	ds3_get_available_chunks_response * chunks   = NULL;
+	ds3_bulk_response                 * response = NULL;
+	ds3_request                       * request  = NULL;
+	ds3_error                         * error    = NULL;
+
+	if (bench_check(bench_bulk(Client, Bucket, Object, Buffer->Length, 0, &response), "Bulk get"))
+		return -1;
+
+	while (1)
+	{
+		request = ds3_init_get_available_chunks(response->job_id->value);
+		error   = ds3_get_available_chunks(Client, request, &chunks);
+		ds3_free_request(request);
+		if (bench_check(error, "Get available chunks"))
+			goto failed;
+		if (chunks->object_list && chunks->object_list->list_size > 0)
+			break;
+		sleep(chunks->retry_after ? chunks->retry_after : 1);
+		ds3_free_available_chunks_response(chunks);
+		chunks = NULL;
+	}
+	ds3_free_available_chunks_response(chunks);
+
+	Buffer->Offset = 0;
+	request = ds3_init_get_object_for_job(Bucket, Object, 0, response->job_id->value);
+	error   = ds3_get_object(Client, request, Buffer, bench_write);
+	ds3_free_request(request);
+	if (bench_check(error, "Get object for job"))
+		goto failed;
+
+	ds3_free_bulk_response(response);
+	return 0;
+
+failed:
+	ds3_free_bulk_response(response);
+	return -1;
+}
+
+/* The SmallObjectSize path: one PUT. */
+static int
+bench_put_direct(ds3_client * Client, char * Bucket, char * Object, bench_buffer_t * Buffer)
+{
+	ds3_request * request = NULL;
+	ds3_error   * error   = NULL;
+
+	Buffer->Offset = 0;
+	request = ds3_init_put_object(Bucket, Object, Buffer->Length);
+	error   = ds3_put_object(Client, request, Buffer, bench_read);
+	ds3_free_request(request);
+	return bench_check(error, "Put object");
+}
+
+/* The SmallObjectSize path: one GET. */
+static int
+bench_get_direct(ds3_client * Client, char * Bucket, char * Object, bench_buffer_t * Buffer)
+{
+	ds3_request * request = NULL;
+	ds3_error   * error   = NULL;
+
+	Buffer->Offset = 0;
+	request = ds3_init_get_object(Bucket, Object, Buffer->Length);
+	error   = ds3_get_object(Client, request, Buffer, bench_write);
+	ds3_free_request(request);
+	return bench_check(error, "Get object");
+}
+
+typedef int (*bench_op)(ds3_client *, char *, char *, bench_buffer_t *);
+
+/* Runs Op on Files objects; returns files per second or -1. */
+static double
+bench_run(ds3_client     * Client,
+          char           * Bucket,
+          const char     * Mode,
+          int              Files,
+          bench_op         Op,
+          bench_buffer_t * Buffer)
+{
+	char   object[256];
+	double start = 0;
+	int    i     = 0;
+
+	start = bench_now();
+	for (i = 0; i < Files; i++)
+	{
+		snprintf(object, sizeof(object), "small_object_bench/%s/%d", Mode, i);
+		if (Op(Client, Bucket, object, Buffer))
+			return -1;
+	}
+	return Files / (bench_now() - start);
+}
+
+static void
+bench_cleanup(ds3_client * Client, char * Bucket, const char * Mode, int Files)
+{
+	ds3_request * request = NULL;
+	char          object[256];
+	int           i       = 0;
+
+	for (i = 0; i < Files; i++)
+	{
+		snprintf(object, sizeof(object), "small_object_bench/%s/%d", Mode, i);
+		request = ds3_init_delete_object(Bucket, object);
+		ds3_free_error(ds3_delete_object(Client, request));
+		ds3_free_request(request);
+	}
+}
+
+int
+main(int argc, char * argv[])
+{
+	static const char * modes[] = {"bulk", "direct"};
+	bench_op            put_ops[] = {bench_put_bulk, bench_put_direct};
+	bench_op            get_ops[] = {bench_get_bulk, bench_get_direct};
+	bench_buffer_t      out;
+	bench_buffer_t      in;
+	ds3_creds         * creds   = NULL;
+	ds3_client        * client  = NULL;
+	double              put     = 0;
+	double              get     = 0;
+	int                 files   = 100;
+	int                 bytes   = 4096;
+	int                 status  = 0;
+	int                 i       = 0;
+
+	if (argc < 3 || !getenv("DS3_ACCESS_KEY") || !getenv("DS3_SECRET_KEY"))
+	{
+		fprintf(stderr, "usage: DS3_ACCESS_KEY=... DS3_SECRET_KEY=... "
+		                "%s <endpoint> <bucket> [files] [bytes]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 3)
+		files = atoi(argv[3]);
+	if (argc > 4)
+		bytes = atoi(argv[4]);
+	if (files < 1 || bytes < 1)
+	{
+		fprintf(stderr, "files and bytes must be positive\n");
+		return 1;
+	}
+
+	memset(&out, 0, sizeof(out));
+	memset(&in, 0, sizeof(in));
+	out.Data   = malloc(bytes);
+	in.Data    = malloc(bytes);
+	out.Length = in.Length = bytes;
+	if (!out.Data || !in.Data)
+	{
+		fprintf(stderr, "No memory for %d byte objects\n", bytes);
+		return 1;
+	}
+	for (i = 0; i < bytes; i++)
+		out.Data[i] = 'a' + i % 26;
+
+	creds  = ds3_create_creds(getenv("DS3_ACCESS_KEY"), getenv("DS3_SECRET_KEY"));
+	client = ds3_create_client(argv[1], creds);
+	if (!creds || !client)
+	{
+		fprintf(stderr, "Can not create a DS3 client for %s\n", argv[1]);
+		return 1;
+	}
+
+	printf("%d objects of %d bytes\n", files, bytes);
+	printf("%8s %14s %14s\n", "path", "PUT files/s", "GET files/s");
+	for (i = 0; i < 2; i++)
+	{
+		put = bench_run(client, argv[2], modes[i], files, put_ops[i], &out);
+		get = put < 0 ? -1 : bench_run(client, argv[2], modes[i], files, get_ops[i], &in);
+		bench_cleanup(client, argv[2], modes[i], files);
+
+		if (put < 0 || get < 0)
+		{
+			status = 1;
+			break;
+		}
+		if (memcmp(in.Data, out.Data, bytes) != 0)
+		{
+			fprintf(stderr, "%s: read back the wrong data\n", modes[i]);
+			status = 1;
+			break;
+		}
+		printf("%8s %14.1f %14.1f\n", modes[i], put, get);
+	}
+
+	ds3_free_client(client);
+	ds3_free_creds(creds);
+	free(out.Data);
+	free(in.Data);
+	return status;
+}